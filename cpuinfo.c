@@ -25,76 +25,88 @@ static char *vers = "1.0.2";
 #include <string.h>
 #include <unistd.h>
 
+#include "genmon.h"
+
 /* Option parsing */
+enum MODE { Cores = 0, Spark, Busiest, Package, Histogram };
+static char *modes[] = { "cores", "spark", "busiest", "package", "histogram", NULL };
+static int busiest = 4;
 static int cpuusage = 0;
-static int debug = 0;
-static char iconfile[256];
+static int mode = -1;
 static int pango = 0;
 static int showfarenheit = 0;
-static int showicon = 1;
+static int showhistory = 0;
 
 /* Pango colors */
-char *coldefault = "default", *yellow = "yellow", *orange = "orange", *red = "red";
-
-static void
-show_version (void)
-{
-	printf ("%s %s - (C) 2013 Digirium, see <https://github.com/Digirium>\n", prog, vers);
-	printf ("Released under the GNU GPL.\n\n");
-}
+static char *coldefault = "default", *yellow = "yellow", *orange = "orange", *red = "red";
 
 static void
 show_help (void)
 {
-	show_version ();
-	
+	genmon_show_version (prog, vers);
+
+	printf ("-bN --busiest=N		Display usage of the N busiest cores.\n");
 	printf ("-c --cpuusage		Display CPU core usage.\n");
-	printf ("-d --debug		Display debugging output.\n");
+	printf (GENMON_HELP_DEBUG);
 	printf ("-F --farenheit		Display temperature in farenheit.\n");
-	printf ("-h --help		Display this help.\n");
-	printf ("-i[FILE] --icon[=FILE]	Set the icon filename, or disable the icon.\n");
+	printf (GENMON_HELP_HELP);
+	printf ("-H --history		Display usage and temperature history in the tool tip.\n");
+	printf (GENMON_HELP_ICON);
+	printf ("-mMODE --mode=MODE	Display CPU usage as cores, spark, busiest, package or histogram.\n");
 	printf ("-p --pango		Generate Pango Markup Language output.\n");
-	printf ("-v --version		Display version information.\n");
+	printf (GENMON_HELP_STATS);
+	printf (GENMON_HELP_VERSION);
+	printf (GENMON_HELP_WAIT);
 
-	printf ("\nLong options may be passed with a single dash.\n\n");
+	printf (GENMON_HELP_LONG);
 }
 
 static void
 get_options (int argc, char *argv[])
 {
-	char *home = getenv ("HOME");
-	assert (home != NULL);
-
-	sprintf (iconfile, "%s/.genmon-icon/%s.png", home, prog);
+	genmon_icon_init (prog);
 
 	if (argc == 1) return;
 
 	static struct option long_opts[] =
 	{
+		{ "busiest",	required_argument,	0, 'b' },
 		{ "cpuusage",	no_argument,		0, 'c' },
 		{ "debug",	no_argument,		0, 'd' },
 		{ "farenheit",	no_argument,		0, 'F' },
 		{ "help",	no_argument,		0, 'h' },
+		{ "history",	no_argument,		0, 'H' },
 		{ "icon",	optional_argument,	0, 'i' },
+		{ "mode",	required_argument,	0, 'm' },
 		{ "pango",	no_argument,		0, 'p' },
+		{ "stats",	no_argument,		0, 's' },
 		{ "version",	no_argument,		0, 'v' },
+		{ "wait",	required_argument,	0, 'w' },
 		{ 0,0,0,0 }
 	};
 
 	int opt, opti;
 
-	while ((opt = getopt_long (argc, argv, "cdfhi::pv", long_opts, &opti)))
+	while ((opt = getopt_long (argc, argv, "b:cdFhHi::m:psvw:", long_opts, &opti)))
 	{
 		if (opt == EOF) break;
 
 		switch (opt)
 		{
+		case 'b':
+			busiest = atoi (optarg);
+			if (busiest < 1)	busiest = 1;
+			if (busiest > 16)	busiest = 16;
+			cpuusage = 1;
+			mode = Busiest;
+			break;
+
 		case 'c':
 			cpuusage = 1;
 			break;
 
 		case 'd':
-			debug = 1;
+			genmon_debug_option (prog, GENMON_DEBUG);
 			break;
 
 		case 'F':
@@ -105,18 +117,25 @@ get_options (int argc, char *argv[])
 			show_help ();
 			exit (0);
 
+		case 'H':
+			showhistory = 1;
+			break;
+
 		case 'i':
-			if (!optarg)
+			genmon_icon_option (optarg);
+			break;
+
+		case 'm':
+			for (mode = 0; modes[mode]; mode++)
+				if (strcmp (optarg, modes[mode]) == 0) break;
+
+			if (!modes[mode])
 			{
-				showicon = 0;
-				break;
+				fprintf (stderr, "%s: unknown mode %s\n", prog, optarg);
+				exit (1);
 			}
 
-			if (*optarg == '/')
-				strcpy (iconfile, optarg);
-			else
-				sprintf (iconfile, "%s/.genmon-icon/%s", home, optarg);
-
+			cpuusage = 1;
 			break;
 
 		case 'p':
@@ -128,201 +147,186 @@ get_options (int argc, char *argv[])
 			pango = 1;
 			break;
 
+		case 's':
+			genmon_debug_option (prog, GENMON_STATS);
+			break;
+
 		case 'v':
-			show_version ();
+			genmon_show_version (prog, vers);
 			exit (0);
 
+		case 'w':
+			genmon_helper_wait = atoi (optarg);
+			break;
+
 		default:
 			exit (1);
 		}
 	}
 }
 
-static char *
-p2s (int percent) /* Percent to string */
+static void
+p2s (int percent) /* Add a percent to the output */
 {
-	char *buffer = (char *)malloc (128);
-
-	if (pango)
+	if (percent >= 100)
 	{
-		if (percent < 80)
-			sprintf (buffer, "%2d%%", percent);
-		else
-		{
-			char *color;
-			
-			if      (percent < 90)	color = yellow;	/* between 80-90 */
-			else if (percent < 100)	color = orange; /* between 90-100 */
-
-			if (percent < 100)
-				sprintf (buffer, "<span foreground=\"%s\">%2d%%</span>", color, percent);
-			else
-				sprintf (buffer, "<span foreground=\"%s\">100</span>", red);
-		}
+		if (pango)	genmon_out ("<span foreground=\"%s\">100</span>", red);
+		else		genmon_out ("100");
 	}
+	else if (pango && percent >= 80)	/* yellow between 80-90, orange between 90-100 */
+		genmon_out ("<span foreground=\"%s\">%2d%%</span>", (percent < 90) ? yellow : orange, percent);
 	else
+		genmon_out ("%2d%%", percent);
+}
+
+static void
+item (int first, char *label, int id, int percent) /* Add a usage to a line */
+{
+	char *sep = first ? "" : " ";
+
+	if (percent < 0)	/* offline */
 	{
-		if (percent < 100)	sprintf (buffer, "%2d%%", percent);
-		else			strcpy (buffer, "100");
+		genmon_out ("%s--", sep);
+		return;
 	}
 
-	return buffer;
+	if (label)	genmon_out ("%s%s%d:", sep, label, id);
+	else		genmon_out ("%s", sep);
+
+	p2s (percent);
+}
+
+static void
+spark (int percent, int color) /* Add a sparkline block for a percent */
+{
+	static char *blocks[] = { "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█" };
+
+	if (percent < 0)	/* offline */
+	{
+		genmon_out (" ");
+		return;
+	}
+
+	char *block = blocks[(percent * 8) / 101];
+
+	if (pango && color && percent >= 80)
+		genmon_out ("<span foreground=\"%s\">%s</span>",
+			(percent < 90) ? yellow : (percent < 100) ? orange : red, block);
+	else
+		genmon_out ("%s", block);
 }
 
 int
 main (int argc, char *argv[])
 {
+	genmon_phase (GENMON_OPTIONS);
 	get_options (argc, argv);
+	genmon_phase (GENMON_PARSE);
 
-	/* Code below was written to support an AMD Phenom(tm) II X4 965 Processor
-	 * and was written assuming there are four cores. In the future it would be
-	 * desirable to make configuration more flexible. The author hopes this does
-	 * not put anyone off adapting the code to the particular CPU that they use.
+	/* Code below was first written to support an AMD Phenom(tm) II X4 965 Processor
+	 * with four cores, and the temperature colors still assume it. Any number of
+	 * cores is handled, those that are offline are shown as such. With more cores
+	 * than fit in the panel, usage is shown in one of the aggregated modes.
 	 */
+	int cpus = genmon_cpus ();
+	assert (cpus > 0);
+	if (cpus > GENMON_MAXCPUS) cpus = GENMON_MAXCPUS;
 
-	/* Monitor was written for a CPU containing four cores and makes assumptions
-	 * about how to get usage statistics, temperature and CPU PWM fan speed. For other
-	 * types of CPUs some editing may be required to adapt different configurations.
-	 */
+	if (mode < 0) mode = (cpus > 8) ? Spark : Cores;
 
-	int cpus = sysconf (_SC_NPROCESSORS_CONF);
-	assert (cpus == 4 || cpus == 2);
+	signed char percent[GENMON_MAXCPUS];	/* -1 when offline */
+	short package[GENMON_MAXCPUS];
+	int maxrpm = 0, rpm = 0, packages = 0, stale = 0, n;
+	float maxtemp = 0.0, temp = 0.0;
 
-	/* Allocate some storage for the previous total and idle values.
+	/* When genmond is running it has already sampled everything, just take
+	 * its latest values.
 	 */
-	int size = sizeof (unsigned long long int) * cpus * 2;
-	unsigned long long int *prev = (unsigned long long int *)malloc (size);
-	(void)memset (prev, 0, size);
+	struct genmond_sample sample;
 
-	/* If cache file exists, read the previous total and idle usage statistics
-	 * and then read the previous maximum temperature and fan speed.
-	 */
-	char format[256], buffer[256];
-	sprintf (format, "/dev/shm/cpuinfo.%d", getuid ());
-	FILE *shm = fopen (format, "r");
-	int maxrpm = 0, n, ret;
-	float maxtemp = 0.0;
-
-	if (shm)
+	if (genmond_attach (&sample) && sample.cpu.cpus == cpus)
 	{
-		for (n = 0; n < cpus; n++)
-		{
-			fgets (buffer, 256, shm);
-			ret = sscanf (buffer, "%llu %llu", prev + 2*n, prev + 2*n + 1);
-			assert (ret == 2);
-		}
-
-		fgets (buffer, 256, shm);
-		ret = sscanf (buffer, "%f %d", &maxtemp, &maxrpm);
-		assert (ret == 2);
-		fclose (shm);
+		memcpy (percent, sample.cpu.percent, cpus);
+		memcpy (package, sample.cpu.package, cpus * sizeof (short));
+		packages = sample.cpu.packages;
+
+		temp	= sample.cpu.temp;
+		maxtemp	= sample.cpu.maxtemp;
+		rpm	= sample.cpu.rpm;
+		maxrpm	= sample.cpu.maxrpm;
+		stale	= sample.cpu.stale;
 	}
-
-	/* Prepare to write a new cache. The total and idle statistics are always
-	 * increasing so the cache is updated every run.
-	 */
-	shm = fopen (format, "w");
-	assert (shm != NULL);
-
-	enum _PROC { User = 0, Nice, System, Idle, IO, Irq, Soft, Steal, Guest };
-	int *percent = (int *)malloc (sizeof (int) * cpus);
-	unsigned long long int proc[10];
-
-	/* Prepare to read CPU statistics from the pseudo-filesystem. With the values
-	 * saved in the cache, the interval values for total and idle can be calculated
-	 * and the CPU usage obtained.
-	 */
-	FILE *file = fopen ("/proc/stat", "r");
-	int i, id = -1;
-
-	for (n = 0; n <= cpus; n++)
+	else	/* No daemon, sample standalone */
 	{
-		unsigned long long int total = 0;
+		/* Map the state file, it holds the previous total and idle usage statistics
+		 * and the previous maximum temperature and fan speed. Without a valid record,
+		 * say the first time the monitor is run, start from zero.
+		 */
+		struct genmon_state *state = genmon_state_open ("cpuinfo", sizeof (struct genmon_cpu_state), 1);
+		struct genmon_cpu_state prev;
+		int valid = 1, online = 0, sum = 0;
 
-		fgets (buffer, 256, file);
+		if (!state || !genmon_state_read (state, GENMON_CPU, &prev, sizeof (prev)))
+		{
+			memset (&prev, 0, sizeof (prev));
+			valid = 0;
+		}
 
-		if (n == 0) continue;
+		maxtemp	= prev.maxtemp;
+		maxrpm	= prev.maxrpm;
 
-		ret = sscanf (buffer, "cpu%d %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
-			&id, proc + 0, proc + 1, proc + 2, proc + 3, proc + 4,
-			proc + 5, proc + 6, proc + 7, proc + 8, proc + 9);
+		/* Read CPU statistics from the pseudo-filesystem. With the values
+		 * saved in the state, the interval values for total and idle can be calculated
+		 * and the CPU usage obtained.
+		 */
+		unsigned long long int total[GENMON_MAXCPUS], idle[GENMON_MAXCPUS];
 
-		assert (ret == 11);
+		genmon_read_stat (cpus, total, idle);
+		genmon_cpu_usage (cpus, total, idle, prev.total, prev.idle, percent);
 
-		/* User + Nice + System + Idle */
-		for (i = 0; i < 4; i++) total += proc[i];
+		memcpy (prev.total, total, cpus * sizeof (total[0]));
+		memcpy (prev.idle, idle, cpus * sizeof (idle[0]));
 
-		int cpu = n - 1;
-		unsigned long long int intervaltotal = total - *(prev + 2*cpu);
-		unsigned long long int intervalidle  = proc[Idle] - *(prev + 2*cpu + 1);
+		/* The package of each core is only needed for the package mode, and
+		 * never changes, so it is read once and kept in the state.
+		 */
+		if (mode == Package && !prev.packages)
+			prev.packages = genmon_cpu_packages (cpus, prev.package);
 
-		*(percent + cpu) = (int)(100.0 * ((float)(intervaltotal - intervalidle)
-			/ (float)intervaltotal));
+		memcpy (package, prev.package, cpus * sizeof (short));
+		packages = prev.packages;
 
-		fprintf (shm, "%llu %llu\n", total, proc[Idle]);
-	}
-	fclose (file);
+		/* Get the CPU temperature and PWM fan speed, the state remembers which
+		 * hwmon files to read them from. When there are none and sensors is
+		 * late, the values are those it gave last.
+		 */
+		stale = (genmon_read_sensors (cpus, &prev.hwmon, NULL, &temp, &rpm) == GENMON_STALE);
 
-	/* Prepare to get the CPU temperature and PWM fan speed. Going to open
-	 * a read pipe to the sensors program to get these values.
-	 */
-	file = popen ("/usr/bin/sensors", "r");
-	assert (file != NULL);
+		/* Keep the maximum values seen so far for temperatue and rpm */
+		if (temp > maxtemp)	maxtemp = temp;
+		if (rpm > maxrpm)	maxrpm = rpm;
 
-	float temp = 0.0;
-	int rpm = 0;
+		prev.maxtemp	= maxtemp;
+		prev.maxrpm	= maxrpm;
 
-	while (fgets (buffer, 256, file))
-	{
-		if (cpus == 4)
-		{
-			switch (buffer[0])
-			{
-			/* CPU temperature */
-			case 't':
-				if (strstr (buffer, "temp1:") == buffer)
-				{
-					ret = sscanf (buffer, "temp1: +%f", &temp);
-					assert (ret == 1);
-				}
+		/* Without genmond the history is kept here, a sample each run. The
+		 * first run has no previous statistics to give a usage.
+		 */
+		for (n = 0; n < cpus; n++)
+			if (percent[n] >= 0) online++, sum += percent[n];
 
-				break;
-					
-			/* CPU Fan Speed */
-			case 'C':
-				if (strstr (buffer, "CPU Fan Speed:") == buffer)
-				{
-					ret = sscanf (buffer, "CPU Fan Speed: %d RPM", &rpm);
-					assert (ret == 1);
-				}
+		if (valid && online)	genmon_history_add ("cpu", (float)sum / online, NULL);
+		if (temp > 0.0 && !stale)	genmon_history_add ("cputemp", temp, NULL);
 
-				break;
-			}
-		}
-		else /* cpus == 2 */
+		/* The total and idle statistics are always increasing so the state is
+		 * updated every run.
+		 */
+		if (state)
 		{
-			switch (buffer[0])
-			{
-			/* CPU temperature */
-			case 'C':
-				if (strstr (buffer, "Core 0:") == buffer)
-				{
-					ret = sscanf (buffer, "Core 0: +%f", &temp);
-					assert (ret == 1);
-				}
-			}
+			genmon_state_write (state, GENMON_CPU, &prev, sizeof (prev));
+			genmon_state_close (state, sizeof (prev));
 		}
 	}
-	pclose (file);
-
-	/* Write the maximum values seen so far for temperatue and rpm to the
-	 * end of the cache.
-	 */
-	if (temp > maxtemp)	maxtemp = temp;
-	if (rpm > maxrpm)	maxrpm = rpm;
-
-	fprintf (shm, "%.1f %d\n", maxtemp, maxrpm);
-	fclose (shm);
 
 	/* Recalculate temperatures as farenheit */
 	char CF = 'C';
@@ -336,12 +340,13 @@ main (int argc, char *argv[])
 
 	/** XFCE GENMON XML **/
 
+	genmon_phase (GENMON_OUTPUT);
+
 	/* Icon */
-	if (showicon) printf ("<img>%s</img>\n", iconfile);
+	genmon_out_img ();
 
 	/* Text */
-	char tempbuf[128], rpmbuf[32];	/* Temperature may include a single pango span */
-	char line1[512], line2[512];	/* Each line may include up to 3 pango spans */
+	const char *buffer = genmon_format ("%3.1f°%c", temp, CF), *tempbuf, *rpmbuf;
 
 	if (pango)
 	{
@@ -351,8 +356,6 @@ main (int argc, char *argv[])
 		 */
 		char *color = coldefault;
 
-		sprintf (buffer, "%3.1f°%c", temp, CF);
-
 		switch (CF)
 		{
 		case 'C':
@@ -363,7 +366,7 @@ main (int argc, char *argv[])
 				else if (temp < 50)	color = orange;
 				else /* temp >= 50 */	color = red;
 			}
-			else /* cpus == 2 */
+			else
 			{
 				if      (temp < 60)	color = coldefault;
 				else if (temp < 70)	color = yellow;
@@ -380,46 +383,157 @@ main (int argc, char *argv[])
 			break;
 		}
 
-		if (strcmp (color, coldefault))
-			sprintf (tempbuf, "<span foreground=\"%s\">%8s</span>", color, buffer);
-		else
-			sprintf (tempbuf, "%8s", buffer); /* use the default foreground */
+		/* NULL uses the default foreground */
+		tempbuf = genmon_span (strcmp (color, coldefault) ? color : NULL, "%8s", buffer);
 	}
 	else
+		tempbuf = genmon_format ("%8s", buffer);
+
+	rpmbuf = genmon_format ("%-4drpm", rpm);
+
+	/* Summary over the online cores, used by the aggregated modes and the
+	 * tool tip. Each of the loops below is a single pass over the cores.
+	 */
+	int online = 0, sum = 0, top[16], tops = 0, hist[10], t;
+
+	memset (hist, 0, sizeof (hist));
+
+	for (n = 0; n < cpus; n++)
 	{
-		sprintf (buffer, "%3.1f°%c", temp, CF);
-		sprintf (tempbuf, "%8s", buffer);
+		if (percent[n] < 0) continue;
+
+		online++;
+		sum += percent[n];
+		hist[(percent[n] < 100) ? percent[n] / 10 : 9]++;
+
+		/* Keep the busiest cores in order, insertion in to a short list */
+		if (tops < busiest || percent[n] > percent[top[tops - 1]])
+		{
+			if (tops < busiest) tops++;
+
+			for (t = tops - 1; t > 0 && percent[top[t - 1]] < percent[n]; t--)
+				top[t] = top[t - 1];
+
+			top[t] = n;
+		}
 	}
 
-	sprintf (rpmbuf, "%-4drpm", rpm);
+	int average = online ? sum / online : 0;
+
+	genmon_out ("<txt>%s", tempbuf);
 
 	if (cpuusage)
 	{
-		if (cpus == 4)
+		int half;
+
+		switch (mode)
+		{
+		case Cores:
+			if (cpus == 2)
+			{
+				/* No fan on the two core CPU, both cores go on the second line */
+				genmon_out ("\n");
+				item (1, NULL, 0, percent[0]);
+				item (0, NULL, 0, percent[1]);
+				break;
+			}
+
+			for (half = (cpus + 1) / 2, n = 0; n < half; n++) item (0, NULL, n, percent[n]);
+			genmon_out ("\n%7s", rpmbuf);
+			for (; n < cpus; n++) item (0, NULL, n, percent[n]);
+			break;
+
+		case Spark:
+			genmon_out (" ");
+			for (half = (cpus + 1) / 2, n = 0; n < half; n++) spark (percent[n], 1);
+			genmon_out ("\n%7s ", rpmbuf);
+			for (; n < cpus; n++) spark (percent[n], 1);
+			break;
+
+		case Busiest:
+			for (half = (tops + 1) / 2, n = 0; n < half; n++) item (0, "", top[n], percent[top[n]]);
+			genmon_out ("\n%7s", rpmbuf);
+			for (; n < tops; n++) item (0, "", top[n], percent[top[n]]);
+			break;
+
+		case Package:
 		{
-			sprintf (line1, "%s %s %s", tempbuf, p2s(*(percent + 0)), p2s(*(percent + 1)));
-			sprintf (line2, "%7s %s %s", rpmbuf, p2s(*(percent + 2)), p2s(*(percent + 3)));
+			int pkgsum[packages], pkgcount[packages], avg[packages];
+
+			memset (pkgsum, 0, sizeof (pkgsum));
+			memset (pkgcount, 0, sizeof (pkgcount));
+
+			for (n = 0; n < cpus; n++)
+				if (percent[n] >= 0 && package[n] < packages)
+				{
+					pkgsum[package[n]] += percent[n];
+					pkgcount[package[n]]++;
+				}
+
+			for (n = 0; n < packages; n++) avg[n] = pkgcount[n] ? pkgsum[n] / pkgcount[n] : -1;
+
+			for (half = (packages + 1) / 2, n = 0; n < half; n++) item (0, "P", n, avg[n]);
+			genmon_out ("\n%7s", rpmbuf);
+			for (; n < packages; n++) item (0, "P", n, avg[n]);
+			break;
 		}
-		else /* cpus == 2 */
+
+		case Histogram:
 		{
-			sprintf (line1, "%s", tempbuf);
-			sprintf (line2, "%s %s", p2s(*(percent + 0)), p2s(*(percent + 1)));
+			/* One block for each tenth of usage, as tall as its share of cores */
+			int most = 1;
+
+			for (n = 0; n < 10; n++) if (hist[n] > most) most = hist[n];
+
+			genmon_out (" ");
+			for (n = 0; n < 10; n++) spark ((hist[n] * 100) / most, 0);
+
+			genmon_out ("\n%7s", rpmbuf);
+			item (0, NULL, 0, average);
+			break;
 		}
+		}
+
+		genmon_out ("</txt>\n");
 	}
+	else	genmon_out ("\n%7s</txt>\n", rpmbuf);
 
-	if (cpuusage)	printf ("<txt>%s\n%s</txt>\n", line1, line2);
-	else		printf ("<txt>%s\n%7s</txt>\n", tempbuf, rpmbuf);
-		
 	/* Tool tip */
-	if (cpus == 4)
+	genmon_out ("<tool>Maximum temperature observed: %.1f°%c", maxtemp, CF);
+
+	if (stale) genmon_out ("\nTemperature is stale, sensors did not answer in time");
+
+	if (cpus == 4 || maxrpm)
+		genmon_out ("\nMaximum RPM observed: %drpm", maxrpm);
+
+	if (cpus > 4 || mode != Cores)
 	{
-		printf ("<tool>Maximum temperature observed: %.1f°%c\n", maxtemp, CF);
-		printf ("Maximum RPM observed: %drpm</tool>", maxrpm);
+		genmon_out ("\nAverage usage: %d%% of %d online CPUs", average, online);
+
+		if (tops) genmon_out ("\nBusiest: cpu%d %d%%", top[0], percent[top[0]]);
+
+		if (mode == Histogram)
+			for (n = 0; n < 10; n++)
+				genmon_out ("\n%3d-%d%%: %d", n * 10, (n < 9) ? n * 10 + 9 : 100, hist[n]);
 	}
-	else /* cpus == 2 */
+
+	if (showhistory)
 	{
-		printf ("<tool>Maximum temperature observed: %.1f°%c</tool>", maxtemp, CF);
+		struct genmon_summary summary[GENMON_WINDOWS];
+
+		if (genmon_history_read ("cpu", summary))
+			genmon_print_history ("Usage", summary, "%.0f%%", 1.0, 0.0);
+
+		if (genmon_history_read ("cputemp", summary))
+		{
+			char fmt[8];
+
+			snprintf (fmt, 8, "%%.1f°%c", CF);
+			genmon_print_history ("Temperature", summary, fmt, showfarenheit ? 1.8 : 1.0, showfarenheit ? 32.0 : 0.0);
+		}
 	}
 
-	return 0;
+	genmon_out ("</tool>");
+
+	return genmon_out_flush () ? 1 : 0;
 }
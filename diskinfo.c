@@ -18,85 +18,120 @@
 static char *prog = "diskinfo";
 static char *vers = "1.0.3";
 
-#include <assert.h>
+#define _GNU_SOURCE	/* statx */
+
+#include <fcntl.h>
 #include <getopt.h>
-#include <mntent.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/statfs.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <unistd.h>
 
+#include "genmon.h"
+
 /* Option parsing */
-static int debug = 0;
-static char iconfile[256];
-static char *mountpath = NULL;
+static int pango = 0;
+static int allmounts = 0;
 static char *hddtemppath = NULL;
 static int showbar = 0;
 static int showfarenheit = 0;
-static int showicon = 1;
+static int showhistory = 0;
+static int ttl = 60;
 
-static void
-show_version (void)
+/* A mount and what it shows. Mounts of partitions on the same disk point at
+ * the first of them, which has the temperature and I/O of the disk.
+ */
+#define MAXMOUNTS	64
+
+struct mount
 {
-	printf ("%s %s - (C) 2013 Digirium, see <https://github.com/Digirium>\n", prog, vers);
-	printf ("Released under the GNU GPL.\n\n");
-}
+	char path[256];
+	dev_t dev;
+	float total, free, used;	/* G */
+	int percent;
+	char diskpath[256];
+	char id[128];
+	unsigned int major, minor;	/* of the whole disk, or 0 */
+	unsigned long long int stats[GENMON_DISKSTATS];
+	struct genmon_diskio io;
+	float temp, maxtemp;
+	int havetemp;
+	int stale;			/* the temperature is the last read, the disk was late */
+	struct mount *disk;
+};
+
+static struct mount mount[MAXMOUNTS];
+static int mounts = 0;
 
 static void
 show_usage (void)
 {
-	printf ("Usage: %s [options] <mountpath>\n", prog);
+	printf ("Usage: %s [options] <mountpath>...\n", prog);
 }
 
 static void
 show_help (void)
 {
-	show_version ();
+	genmon_show_version (prog, vers);
 	show_usage ();
-	
-	printf ("\n-d --debug		Display debugging output.\n");
-	printf ("-h --help		Display this help.\n");
+
+	printf ("\n-a --all		Display every mounted block device filesystem.\n");
+	printf (GENMON_HELP_DEBUG);
+	printf (GENMON_HELP_HELP);
+	printf ("-H --history		Display temperature history in the tool tip.\n");
 	printf ("-F --farenheit		Display temperature in farenheit.\n");
-	printf ("-i[FILE] --icon[=FILE]	Set the icon filename, or disable the icon.\n");
+	printf (GENMON_HELP_ICON);
 	printf ("-p --percentbar		Display the percent bar.\n");
+	printf ("-P --pango		Generate Pango Markup Language output.\n");
+	printf (GENMON_HELP_STATS);
 	printf ("-tDISK --disktemp=DISK	Set the disk path to read temperature from.\n");
-	printf ("-v --version		Display version information.\n");
+	printf ("-TSECS --ttl=SECS	Read SMART temperatures at most every SECS (default 60).\n");
+	printf (GENMON_HELP_VERSION);
+	printf (GENMON_HELP_WAIT);
 
-	printf ("\nLong options may be passed with a single dash.\n\n");
+	printf (GENMON_HELP_LONG);
 }
 
 static void
 get_options (int argc, char *argv[])
 {
-	char *home = getenv ("HOME");
-	assert (home != NULL);
-
-	sprintf (iconfile, "%s/.genmon-icon/%s.png", home, prog);
+	genmon_icon_init (prog);
 
 	static struct option long_opts[] =
 	{
+		{ "all",	no_argument,		0, 'a' },
 		{ "debug",	no_argument,		0, 'd' },
 		{ "disktemp",	required_argument,	0, 't' },
 		{ "farenheit",	no_argument,		0, 'F' },
 		{ "help",	no_argument,		0, 'h' },
+		{ "history",	no_argument,		0, 'H' },
 		{ "icon",	optional_argument,	0, 'i' },
+		{ "pango",	no_argument,		0, 'P' },
 		{ "percentbar",	no_argument,		0, 'p' },
+		{ "stats",	no_argument,		0, 's' },
+		{ "ttl",	required_argument,	0, 'T' },
 		{ "version",	no_argument,		0, 'v' },
+		{ "wait",	required_argument,	0, 'w' },
 		{ 0,0,0,0 }
 	};
 
 	int opt, opti;
 
-	while ((opt = getopt_long (argc, argv, "dFhi::pt:v", long_opts, &opti)))
+	while ((opt = getopt_long (argc, argv, "adFhHi::pPsT:t:vw:", long_opts, &opti)))
 	{
 		if (opt == EOF) break;
 
 		switch (opt)
 		{
+		case 'a':
+			allmounts = 1;
+			break;
+
 		case 'd':
-			debug = 1;
+			genmon_debug_option (prog, GENMON_DEBUG);
 			break;
 
 		case 'F':
@@ -107,201 +142,528 @@ get_options (int argc, char *argv[])
 			show_help ();
 			exit (0);
 
-		case 'i':
-			if (!optarg)
-			{
-				showicon = 0;
-				break;
-			}
-
-			if (*optarg == '/')
-				strcpy (iconfile, optarg);
-			else
-				sprintf (iconfile, "%s/.genmon-icon/%s", home, optarg);
+		case 'H':
+			showhistory = 1;
+			break;
 
+		case 'i':
+			genmon_icon_option (optarg);
 			break;
 
 		case 'p':
 			showbar = 1;
 			break;
 
+		case 'P':
+			/* Color the utilisation of the disk as cpuinfo does the usage of
+			 * its cores, yellow, orange and then red as it gets busier.
+			 */
+			pango = 1;
+			break;
+
+		case 's':
+			genmon_debug_option (prog, GENMON_STATS);
+			break;
+
+		case 'T':
+			if ((ttl = atoi (optarg)) < 0) ttl = 0;
+			break;
+
 		case 't':
 			hddtemppath = optarg;
 			break;
 
 		case 'v':
-			show_version ();
+			genmon_show_version (prog, vers);
 			exit (0);
 
+		case 'w':
+			genmon_helper_wait = atoi (optarg);
+			break;
+
 		default:
 			exit (1);
 		}
 	}
 
-	if (optind >= argc)
+	if (optind >= argc && !allmounts)
 	{
 		show_usage ();
 		exit (1);
 	}
 
-	mountpath = argv[optind];
+	if (argc - optind > MAXMOUNTS)
+	{
+		fprintf (stderr, "%s: at most %d mounts\n", prog, MAXMOUNTS);
+		exit (1);
+	}
+
+	for (mounts = 0; optind < argc; optind++)
+		snprintf (mount[mounts++].path, 256, "%s", argv[optind]);
 }
 
-static char *
+/* Pango colors */
+static char *yellow = "yellow", *orange = "orange", *red = "red";
+
+static const char *
+u2s (float util) /* Utilisation to string */
+{
+	int percent = (int)util;
+
+	if (!pango || percent < 80)	return genmon_format ("%d%%", percent);
+	else if (percent < 100)		return genmon_span ((percent < 90) ? yellow : orange, "%d%%", percent);
+	else				return genmon_span (red, "100%%");
+}
+
+static const char *
 du (float usage)
 {
-	char *buf = (char *)malloc (32);
+	if (usage > 100.0)	return genmon_format ("%d", (int)usage);
+	else			return genmon_format ("%.1f", usage);
+}
+
+/* Copy a field of mountinfo, where spaces and the like are written in octal */
+static const char *
+unescape (const char *p, char *buffer, int size)
+{
+	int n = 0;
+
+	for (; *p && *p != ' ' && *p != '\n'; p++)
+	{
+		char c = *p;
 
-	if (usage > 100.0)	sprintf (buf, "%d", (int)usage);
-	else			sprintf (buf, "%.1f", usage);
-		
-	return buf;
+		if (c == '\\' && (unsigned)(p[1] - '0') < 4 && (unsigned)(p[2] - '0') < 8 && (unsigned)(p[3] - '0') < 8)
+		{
+			c = ((p[1] - '0') << 6) | ((p[2] - '0') << 3) | (p[3] - '0');
+			p += 3;
+		}
+
+		if (n < size - 1) buffer[n++] = c;
+	}
+
+	buffer[n] = '\0';
+	return p;
 }
 
-int
-main (int argc, char *argv[])
+/* Find the filesystems on block devices, once each however many times they are
+ * mounted. Loop devices, mostly read only images, are left out.
+ */
+static void
+find_mounts (void)
 {
-	get_options (argc, argv);
+	const char *p, *q, *eol;
+	unsigned int maj, min;
+	char source[32];
+	int i, field;
+
+	for (p = genmon_read_proc ("/proc/self/mountinfo"); p && *p && mounts < MAXMOUNTS; p = eol ? eol + 1 : NULL)
+	{
+		eol = strchr (p, '\n');
+
+		q = p;
+		genmon_scan (&q);	/* mount ID */
+		genmon_scan (&q);	/* parent ID */
+
+		maj = genmon_scan (&q);
+		if (*q++ != ':') continue;
+		min = genmon_scan (&q);
+
+		for (i = 0; i < mounts; i++)
+			if (major (mount[i].dev) == maj && minor (mount[i].dev) == min) break;
+
+		if (i < mounts) continue;
+
+		/* Past the root of the mount to the mount point */
+		if (*q++ != ' ' || !(q = strchr (q, ' '))) continue;
+		unescape (q + 1, mount[mounts].path, 256);
+
+		/* The source follows the separator and the filesystem type */
+		if (!(q = strstr (q, " - ")) || (eol && q > eol)) continue;
+
+		for (q += 3, field = 0; *q && *q != '\n' && field < 1; q++)
+			if (*q == ' ') field++;
+
+		unescape (q, source, 32);
+
+		if (strncmp (source, "/dev/", 5) || !strncmp (source, "/dev/loop", 9)) continue;
+
+		mount[mounts++].dev = makedev (maj, min);
+	}
+}
+
+/* Under a root the device number and ID of a mount come from the captured
+ * mount table, as a statx of the copy of the mount point would give those of
+ * the filesystem it is on here. The mount point that holds the path is the
+ * longest that leads up to it, the last of them if one was mounted over.
+ * Returns -1 if there is none.
+ */
+static int
+captured_mount (const char *path, struct statx *stx)
+{
+	const char *p, *q, *eol;
+	unsigned int id, maj, min;
+	char point[256];
+	int len, best = -1;
+
+	for (p = genmon_read_proc ("/proc/self/mountinfo"); p && *p; p = eol ? eol + 1 : NULL)
+	{
+		eol = strchr (p, '\n');
+
+		q = p;
+		id = genmon_scan (&q);
+		genmon_scan (&q);	/* parent ID */
+
+		maj = genmon_scan (&q);
+		if (*q++ != ':') continue;
+		min = genmon_scan (&q);
 
+		if (*q++ != ' ' || !(q = strchr (q, ' '))) continue;
+		unescape (q + 1, point, 256);
+
+		len = strlen (point);
+		if (len > 1 && (strncmp (path, point, len) || (path[len] && path[len] != '/'))) continue;
+		if (len < best) continue;
+
+		best = len;
+		stx->stx_dev_major	= maj;
+		stx->stx_dev_minor	= min;
+		stx->stx_mnt_id		= id;
+		stx->stx_mask		= STATX_MNT_ID;
+	}
+
+	return (best < 0) ? -1 : 0;
+}
+
+/* Sample a mount, from genmond when it is watching it or else standalone.
+ * Returns 0, or the exit status diskinfo has always given for a bad mount.
+ */
+static int
+sample_mount (struct mount *m, struct genmond_sample *sample)
+{
 	struct statfs fsbuf;
-	float disktotal, diskfree, diskused;
-	int diskpercent;
+	int loop;
 
-	if (statfs (mountpath, &fsbuf) < 0) exit (2);
+	if (statfs (genmon_path (m->path), &fsbuf) < 0 || !fsbuf.f_blocks) return 2;
 
 	float mbratio = ((float)fsbuf.f_bsize) / 1048576.0;
 
-	disktotal	= (fsbuf.f_blocks * mbratio) / 1024.0;
-	diskfree	= (fsbuf.f_bfree * mbratio) / 1024.0;
-	diskused	= disktotal - diskfree;
+	m->total	= (fsbuf.f_blocks * mbratio) / 1024.0;
+	m->free		= (fsbuf.f_bfree * mbratio) / 1024.0;
+	m->used		= m->total - m->free;
 
-	diskpercent = (100 * (fsbuf.f_blocks - fsbuf.f_bfree)) / fsbuf.f_blocks;
+	m->percent = (100 * (fsbuf.f_blocks - fsbuf.f_bfree)) / fsbuf.f_blocks;
 
-	/* For hddtemp, the mount path needs to be looked up in a mount table to find
-	 * the corresponding device. To speed things up when the monitor is run again, the
-	 * device path is available from the cache. Repeated mount table scans avoided.
+	/* For the temperature and I/O, the device number of the mount path is looked up
+	 * to find the corresponding device. To speed things up when the monitor is run
+	 * again, the device path is available from the state file. The ID of the mount
+	 * is kept with it, a different one means it has been remounted since.
 	 */
-	struct stat mountstat;
+	struct statx mountstx;
 
-	if (stat (mountpath, &mountstat) < 0) exit (3);
+	if ((*genmon_root () ? captured_mount (m->path, &mountstx)
+		: statx (AT_FDCWD, m->path, 0, STATX_MNT_ID, &mountstx)) < 0) return 3;
 
-	char cachepath[256], cachedisk[256], buffer[256], mntbuffer[256];
-	float maxdisktemp = 0.0, disktemp = 0.0;
-	int cacheupdate = 0, ret;
-	struct mntent mountent;
-	char *diskpath = NULL;
-	FILE *file;
+	m->dev = makedev (mountstx.stx_dev_major, mountstx.stx_dev_minor);
+	unsigned long long int mntid = (mountstx.stx_mask & STATX_MNT_ID) ? mountstx.stx_mnt_id : 0;
 
-	sprintf (cachepath, "/dev/shm/diskinfo.%d.%d.%d",
-		major (mountstat.st_dev), minor (mountstat.st_dev), getuid ());
-
-	/* If the cache exists, read it instead of scanning the mount table. The device
-	 * path is added to the cache the first time the monitor is run. If the cache does
-	 * not yet exist, then need to scan a mount table to find the device path.
+	/* When genmond is watching the mount, it has the device path and
+	 * temperatures already.
 	 */
-	if ((file = fopen (cachepath, "r")))
+	struct genmond_disk *disk = NULL;
+
+	if (sample)
+		for (loop = 0; loop < sample->disks; loop++)
+			if (sample->disk[loop].dev == m->dev && sample->disk[loop].id[0])
+				disk = sample->disk + loop;
+
+	if (disk)
 	{
-		char cachemount[256];
+		snprintf (m->diskpath, 256, "%s", disk->diskpath);
+		snprintf (m->id, 128, "%s", disk->id);
+		m->major	= disk->major;
+		m->minor	= disk->minor;
+		m->temp		= disk->disktemp;
+		m->maxtemp	= disk->maxdisktemp;
+		m->havetemp	= (m->temp != 0.0);
+		m->stale	= disk->stale;
+		m->io		= disk->io;
+		return 0;
+	}
+
+	/* No daemon, sample standalone. The state file keeps the device path, it
+	 * is added the first time the monitor is run. The file is named after the
+	 * device number, so any mount of the same filesystem shares it.
+	 */
+	struct genmon_disk_state cache;
+	struct genmon_state *state;
+	char name[64];
+
+	snprintf (name, 64, "diskinfo.%d.%d", major (m->dev), minor (m->dev));
 
-		fgets (buffer, 256, file);
-		ret = sscanf (buffer, "%s %s %f", cachemount, cachedisk, &maxdisktemp);
-		assert (ret == 3);
-		fclose (file);
+	state = genmon_state_open (name, sizeof (struct genmon_disk_state), 1);
 
-		assert (strcmp (mountpath, cachemount) == 0);
-		diskpath = cachedisk;
+	if (state && genmon_state_read (state, GENMON_DISK, &cache, sizeof (cache))
+		&& cache.diskpath[0] && cache.mntid == mntid)
+	{
+		m->maxtemp = cache.maxdisktemp;
 	}
-	else	/* Scan a mount table to get the device path */
+	else	/* Look up the device path */
 	{
-		struct stat mntstat;
-
-		file = setmntent ("/proc/mounts", "r");
-		assert (file != NULL);
+		memset (&cache, 0, sizeof (cache));
+		cache.mntid = mntid;
 
-		while (getmntent_r (file, &mountent, mntbuffer, 256))
+		if (!genmon_mount_device (m->dev, cache.diskpath, 256))
 		{
-			if (stat (mountent.mnt_dir, &mntstat)) continue;
-			
-			/* NB: Will looking for an entry beginning with slash always work? */
-			if (mountstat.st_dev == mntstat.st_dev && mountent.mnt_fsname[0] == '/')
-			{
-				diskpath = mountent.mnt_fsname;
-				break;
-			}
+			if (state) genmon_state_close (state, sizeof (cache));
+			return 3;
 		}
 
-		endmntent (file);
-		cacheupdate = 1;
+		/* I/O is counted for the whole disk a partition is on */
+		char diskname[64];
+
+		if (!genmon_block_disk (cache.diskpath, diskname, 64)
+			|| !genmon_block_devnum (diskname, &cache.major, &cache.minor))
+			cache.major = cache.minor = 0;
 	}
-	assert (diskpath != NULL);
-
-	/* Get the current temperature of the disk. Use hddtemp for this because is has a
-	 * reference database for most HDDs.  Might be quicker to consult the daemonized version
-	 * of hddtemp, will debate that idea for a future modification to this program. However,
-	 * because this program is intended to be run only infrequently say every 30 seconds there
-	 * is not all that much overhead in piping input from hddtemp. And there are minimal
-	 * processes that need to be left running all the time when using a pipe.
+	snprintf (m->diskpath, 256, "%s", cache.diskpath);
+	m->major = cache.major;
+	m->minor = cache.minor;
+
+	/* A disk another mount is on has been read already, its figures are
+	 * shared rather than read again.
 	 */
-	char hddtemp[256], *ID = NULL;
-	sprintf (hddtemp, "sudo hddtemp %s", (hddtemppath ? hddtemppath : diskpath));
-	
-	if ((file = popen (hddtemp, "r")))
-	{
-		char *temp;
+	struct mount *first = NULL;
 
-		fgets (buffer, 256, file);
-		pclose (file);
+	if (m->major && !hddtemppath)
+		for (first = mount; first < m; first++)
+			if (first->major == m->major && first->minor == m->minor && first->diskpath[0]) break;
 
-		temp = strstr((ID = strstr(buffer, ": ") + 2), ": ") + 2;
-		*(temp - 2) = temp[strlen (temp) - 1] = '\0';
-		disktemp = atof (temp);
+	unsigned long long int nanos = genmon_nanos ();
 
-		if (disktemp > maxdisktemp)
+	if (first && first < m)
+	{
+		memcpy (cache.stats, first->stats, sizeof (cache.stats));
+		m->io		= first->io;
+		m->temp		= first->temp;
+		m->havetemp	= first->havetemp;
+		m->stale	= first->stale;
+		snprintf (m->id, 128, "%s", first->id);
+	}
+	else
+	{
+		/* The load on the disk since the last run */
+		unsigned long long int stats[GENMON_DISKSTATS];
+
+		memset (&m->io, 0, sizeof (m->io));
+
+		if (cache.major && genmon_read_diskstats (cache.major, cache.minor, stats))
 		{
-			maxdisktemp = disktemp;
-			cacheupdate = 1;
+			if (cache.nanos) genmon_disk_io (stats, cache.stats, nanos - cache.nanos, &m->io);
+			memcpy (cache.stats, stats, sizeof (stats));
 		}
+		else	/* Nothing for the next run to take a rate from */
+			nanos = 0;
+
+		/* Get the current temperature of the disk. The state remembers where it
+		 * comes from, a drivetemp or nvme hwmon input which costs a read, or else
+		 * SMART, which is only read again once the last value is ttl seconds old.
+		 */
+		m->havetemp = genmon_read_disktemp ((hddtemppath ? hddtemppath : m->diskpath), &cache.disktemp, ttl, &m->temp);
+		m->stale = (m->havetemp == GENMON_STALE);
+		snprintf (m->id, 128, "%s", cache.disktemp.id);
+	}
+	memcpy (m->stats, cache.stats, sizeof (m->stats));
+	cache.nanos = nanos;
+
+	if (m->temp > m->maxtemp) m->maxtemp = m->temp;
+
+	/* Without genmond the history is kept here, a sample each run */
+	snprintf (name, 64, "disktemp.%d.%d", major (m->dev), minor (m->dev));
+	if (m->havetemp && !m->stale) genmon_history_add (name, m->temp, NULL);
+
+	/* The disk statistics always change, so the state is updated every run */
+	if (state)
+	{
+		memcpy (cache.mountpath, m->path, sizeof (cache.mountpath));	/* the same size */
+		cache.maxdisktemp = m->maxtemp;
+		genmon_state_write (state, GENMON_DISK, &cache, sizeof (cache));
+		genmon_state_close (state, sizeof (cache));
 	}
-	assert (ID != NULL);
 
-	/* Create a new cache or update the cache if there is new maximum disk
-	 * temperature. Avoid unnecessary cache writes.
+	return 0;
+}
+
+static void
+print_history (struct mount *m, char CF)
+{
+	struct genmon_summary summary[GENMON_WINDOWS];
+	char name[64], fmt[8];
+
+	snprintf (name, 64, "disktemp.%d.%d", major (m->dev), minor (m->dev));
+	snprintf (fmt, 8, "%%.0f°%c", CF);
+
+	if (genmon_history_read (name, summary))
+		genmon_print_history ("Temperature", summary, fmt, showfarenheit ? 1.8 : 1.0, showfarenheit ? 32.0 : 0.0);
+}
+
+int
+main (int argc, char *argv[])
+{
+	genmon_phase (GENMON_OPTIONS);
+	get_options (argc, argv);
+	genmon_phase (GENMON_PARSE);
+
+	struct genmond_sample sample;
+	int attached, i, j, ret;
+
+	if (allmounts) find_mounts ();
+
+	attached = genmond_attach (&sample);
+
+	/* A mount that is given on its own has to work, of several those that do
+	 * are shown.
 	 */
-	if (cacheupdate)
-		if ((file = fopen (cachepath, "w")))
+	for (i = j = 0; i < mounts; i++)
+	{
+		if ((ret = sample_mount (mount + i, attached ? &sample : NULL)))
 		{
-			fprintf (file, "%s %s %f\n", mountpath, diskpath, maxdisktemp);
-			fclose (file);
+			if (mounts == 1) exit (ret);
+			if (genmon_debug & GENMON_DEBUG) fprintf (stderr, "%s: cannot sample %s\n", prog, mount[i].path);
+			continue;
 		}
 
+		if (j < i) mount[j] = mount[i];
+		j++;
+	}
+
+	if (!(mounts = j)) exit (2);
+
+	/* The first mount on each disk stands for the disk */
+	for (i = 0; i < mounts; i++)
+	{
+		mount[i].disk = mount + i;
+
+		for (j = 0; j < i; j++)
+			if (mount[i].major && mount[j].major == mount[i].major && mount[j].minor == mount[i].minor)
+			{
+				mount[i].disk = mount[j].disk;
+				break;
+			}
+	}
+
 	/* Recalculate temperatures as farenheit */
 	char CF = 'C';
 	if (showfarenheit)
 	{
 		CF = 'F';
-		disktemp = (disktemp * 1.8) + 32.0;
-		maxdisktemp = (maxdisktemp * 1.8) + 32.0;
+
+		for (i = 0; i < mounts; i++)
+		{
+			mount[i].temp = (mount[i].temp * 1.8) + 32.0;
+			mount[i].maxtemp = (mount[i].maxtemp * 1.8) + 32.0;
+		}
 	}
 
 	/** XFCE GENMON XML **/
 
+	genmon_phase (GENMON_OUTPUT);
+
 	/* Icon */
-	printf ("<img>%s</img>\n", iconfile);
+	genmon_out_img ();
 
-	/* Text */
-	printf ("<txt>%d°%c\n%sG</txt>\n", (int)disktemp, CF, du(diskused));
+	const char *utilbuf;
+	struct mount *m = mount;
 
-	/* Tool tip */
-	printf ("<tool>ID: %s\n", ID);
-	printf ("Mount: %s  Device: %s\n", mountpath, diskpath);
+	if (mounts == 1)
+	{
+		/* Text */
+		utilbuf = u2s (m->io.util);
 
-	printf ("Total: %.2fG  Available: %.2fG  Used: %.2fG (%d%%)\n",
-		disktotal, diskfree, diskused, diskpercent);
+		if (m->havetemp)	genmon_out ("<txt>%d°%c %s\n%sG</txt>\n", (int)m->temp, CF, utilbuf, du (m->used));
+		else			genmon_out ("<txt>--°%c %s\n%sG</txt>\n", CF, utilbuf, du (m->used));
 
-	printf ("Maximum temperature observed: %d°%c</tool>\n", (int)maxdisktemp, CF);
+		/* Tool tip */
+		genmon_out ("<tool>ID: %s\n", genmon_escape (m->id));
+		genmon_out ("Mount: %s  Device: %s\n", genmon_escape (m->path), genmon_escape (m->diskpath));
 
-	/* Percent bar */
-	if (showbar) printf ("<bar>%d</bar>\n", diskpercent);
+		genmon_out ("Total: %.2fG  Available: %.2fG  Used: %.2fG (%d%%)\n",
+			m->total, m->free, m->used, m->percent);
 
-	return 0;
+		genmon_out ("Read: %.2fM/s  Write: %.2fM/s\n", m->io.readrate / 1048576.0, m->io.writerate / 1048576.0);
+		genmon_out ("IOPS: %.0f  Await: %.1fms  Utilisation: %s\n", m->io.iops, m->io.await, utilbuf);
+
+		genmon_out ("Maximum temperature observed: %d°%c", (int)m->maxtemp, CF);
+
+		if (m->stale) genmon_out ("\nTemperature is stale, the disk did not answer in time");
+
+		if (showhistory) print_history (m, CF);
+
+		genmon_out ("</tool>\n");
+
+		/* Percent bar */
+		if (showbar) genmon_out_bar (m->percent);
+
+		return genmon_out_flush () ? 1 : 0;
+	}
+
+	/* Several mounts. The text has the temperature and utilisation of each
+	 * disk on the first line, the space used on all the mounts on the second,
+	 * which stays short however many there are. Each is in the tool tip.
+	 */
+	genmon_out ("<txt>");
+
+	for (i = 0; i < mounts; i++)
+	{
+		if (mount[i].disk != mount + i) continue;
+
+		utilbuf = u2s (mount[i].io.util);
+
+		if (mount[i].havetemp)	genmon_out ("%s%d°%c %s", i ? "  " : "", (int)mount[i].temp, CF, utilbuf);
+		else			genmon_out ("%s--°%c %s", i ? "  " : "", CF, utilbuf);
+	}
+
+	float used = 0.0;
+
+	for (i = 0; i < mounts; i++) used += mount[i].used;
+
+	genmon_out ("\n%sG</txt>\n", du (used));
+
+	/* Tool tip, each disk followed by the mounts on it */
+	genmon_out ("<tool>");
+
+	for (i = 0; i < mounts; i++)
+	{
+		m = mount + i;
+		if (m->disk != m) continue;
+
+		genmon_out ("%sID: %s\n", i ? "\n\n" : "", genmon_escape (m->id));
+		genmon_out ("Read: %.2fM/s  Write: %.2fM/s\n", m->io.readrate / 1048576.0, m->io.writerate / 1048576.0);
+		genmon_out ("IOPS: %.0f  Await: %.1fms  Utilisation: %s\n", m->io.iops, m->io.await, u2s (m->io.util));
+
+		if (m->havetemp)	genmon_out ("Temperature: %d°%c  Maximum observed: %d°%c", (int)m->temp, CF, (int)m->maxtemp, CF);
+		else			genmon_out ("Temperature: --°%c", CF);
+
+		if (m->stale) genmon_out (" (stale)");
+
+		for (j = i; j < mounts; j++)
+			if (mount[j].disk == m)
+				genmon_out ("\nMount: %s  Device: %s\n  Total: %.2fG  Available: %.2fG  Used: %.2fG (%d%%)",
+					genmon_escape (mount[j].path), genmon_escape (mount[j].diskpath),
+					mount[j].total, mount[j].free, mount[j].used, mount[j].percent);
+
+		if (showhistory) print_history (m, CF);
+	}
+
+	genmon_out ("</tool>\n");
+
+	/* Percent bar, of the fullest mount */
+	if (showbar)
+	{
+		for (i = j = 0; i < mounts; i++)
+			if (mount[i].percent > j) j = mount[i].percent;
+
+		genmon_out_bar (j);
+	}
+
+	return genmon_out_flush () ? 1 : 0;
 }
@@ -0,0 +1,1160 @@
+/*
+ * ffpcsyncd.c - Firefox profile cache sync daemon for the ffpcsync monitor.
+ * Copyright (C) 2013 Digirium, see <https://github.com/Digirium/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+static char *prog = "ffpcsyncd";
+static char *vers = "1.0.0";
+
+#define _GNU_SOURCE	/* copy_file_range, ppoll */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/fs.h>
+#include <poll.h>
+#include <signal.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "genmon.h"
+
+/* Option parsing */
+static int debug = 0;
+static int mode = 0;		/* 0 runs the daemon, else the request for it */
+static char *srcpath = NULL;
+static char *dstpath = NULL;
+
+/* Every file and directory of the memory cache, with what it takes up and
+ * whether it has changed since the last sync. The paths, relative to the
+ * cache, are kept in an arena and looked up through an open addressed hash
+ * table. The root of the cache is the entry with the empty path.
+ */
+#define MAXENTRIES	65536
+#define MAXWATCHES	16384
+#define ARENA		(8 << 20)
+
+struct entry
+{
+	unsigned int path;		/* offset in to the arena */
+	unsigned int length;
+	unsigned long long int bytes;	/* allocated, as du counts */
+	unsigned char type;		/* DT_REG, DT_DIR or DT_LNK, 0 once gone */
+	unsigned char dirty;
+	unsigned char written;		/* modified since its size was looked at */
+	unsigned char sidecar;		/* of a database, SIDECAR_LOG or SIDECAR_SHM */
+	unsigned long long int snapshot;	/* of a database, when last copied */
+};
+
+#define SIDECAR_LOG	1
+#define SIDECAR_SHM	2
+
+/* Seconds at most that the size of a file being written, which is otherwise
+ * only looked at again once it is closed, goes without being looked at.
+ */
+#define RESIZE		5
+
+static struct entry entry[MAXENTRIES];
+static unsigned int entries = 0;
+static unsigned int table[MAXENTRIES * 2];	/* 0 for empty, else index + 1 */
+static char arena[ARENA];
+static unsigned int arenalen = 0;
+
+/* The directory entry each inotify watch is on, in an open addressed hash
+ * table by watch descriptor, 0 for empty. Descriptors only grow over the life
+ * of the inotify instance, so they are not used as indices.
+ */
+struct watch
+{
+	int wd;
+	unsigned int entry;
+};
+
+static struct watch watch[MAXWATCHES * 2];
+static unsigned int watches = 0;
+
+static int srcfd = -1, dstfd = -1, inotifyfd = -1;
+static char dstroot[PATH_MAX];
+static struct genmon_ffpc_state status;
+static struct genmon_state *state = NULL;
+static int rescan = 0;
+static int written = 0;				/* some entry is */
+static unsigned long long int resized = 0;	/* when they were last looked at */
+
+static volatile sig_atomic_t quit = 0, syncnow = 0;
+
+static void
+show_version (void)
+{
+	printf ("%s %s - (C) 2013 Digirium, see <https://github.com/Digirium>\n", prog, vers);
+	printf ("Released under the GNU GPL.\n\n");
+}
+
+static void
+show_usage (void)
+{
+	printf ("Usage: %s [options] <cachedir> <diskdir>\n", prog);
+	printf ("       %s -k|-q|-s <cachedir>\n", prog);
+}
+
+static void
+show_help (void)
+{
+	show_version ();
+	show_usage ();
+
+	printf ("\n-d --debug		Display debugging output.\n");
+	printf ("-h --help		Display this help.\n");
+	printf ("-k --kill		Sync one last time and stop the daemon.\n");
+	printf ("-q --query		Display the cache size and the time of the last sync.\n");
+	printf ("-s --sync		Sync now and then display as -q does.\n");
+	printf ("-v --version		Display version information.\n");
+
+	printf ("\nWithout -k, -q or -s, watches the cache and copies what changes in it to\n");
+	printf ("the disk directory whenever asked to sync.\n");
+	printf ("\nLong options may be passed with a single dash.\n\n");
+}
+
+static void
+get_options (int argc, char *argv[])
+{
+	static struct option long_opts[] =
+	{
+		{ "debug",	no_argument,		0, 'd' },
+		{ "help",	no_argument,		0, 'h' },
+		{ "kill",	no_argument,		0, 'k' },
+		{ "query",	no_argument,		0, 'q' },
+		{ "sync",	no_argument,		0, 's' },
+		{ "version",	no_argument,		0, 'v' },
+		{ 0,0,0,0 }
+	};
+
+	int opt, opti;
+
+	while ((opt = getopt_long (argc, argv, "dhkqsv", long_opts, &opti)))
+	{
+		if (opt == EOF) break;
+
+		switch (opt)
+		{
+		case 'd':	debug = 1;		break;
+		case 'k':
+		case 'q':
+		case 's':	mode = opt;		break;
+
+		case 'h':
+			show_help ();
+			exit (0);
+
+		case 'v':
+			show_version ();
+			exit (0);
+
+		default:
+			exit (2);
+		}
+	}
+
+	if (optind + (mode ? 1 : 2) > argc)
+	{
+		show_usage ();
+		exit (2);
+	}
+
+	srcpath = argv[optind];
+	dstpath = argv[optind + 1];
+}
+
+static const char *
+path_of (unsigned int i)
+{
+	return entry[i].length ? arena + entry[i].path : ".";
+}
+
+static unsigned int
+hash (const char *path, int length)
+{
+	unsigned int h = 2166136261U;
+
+	while (length--) h = (h ^ (unsigned char)*path++) * 16777619U;
+
+	return h;
+}
+
+/* Find the entry for a path, adding it when add is set. Returns its index, or
+ * -1 when it is not there or there is no room, and then a rescan is due.
+ */
+static int
+find (const char *path, int length, int add)
+{
+	unsigned int mask = MAXENTRIES * 2 - 1, slot = hash (path, length) & mask;
+
+	for (; table[slot]; slot = (slot + 1) & mask)
+	{
+		struct entry *e = entry + table[slot] - 1;
+
+		if (e->length == (unsigned int)length && !memcmp (arena + e->path, path, length)) return table[slot] - 1;
+	}
+
+	if (!add) return -1;
+
+	if (entries >= MAXENTRIES || arenalen + length + 1 > ARENA)
+	{
+		rescan = 1;
+		return -1;
+	}
+
+	struct entry *e = entry + entries;
+
+	memcpy (arena + arenalen, path, length);
+	arena[arenalen + length] = '\0';
+
+	e->path = arenalen;
+	e->length = length;
+	e->bytes = 0;
+	e->type = 0;
+	e->dirty = 0;
+	e->written = 0;
+	e->sidecar = 0;
+	e->snapshot = 0;
+
+	arenalen += length + 1;
+	table[slot] = ++entries;
+
+	return entries - 1;
+}
+
+/* Files that are not copied, as the lock symlink of a running Firefox */
+static int
+is_excluded (const char *name)
+{
+	return !strcmp (name, "lock");
+}
+
+/* SQLite keeps a rollback journal or a write-ahead log beside a database,
+ * named after it, and for the log a shared memory index too. They are not
+ * copied, the database is copied as a whole, with whatever they hold. Returns
+ * the length of the path of the database a path belongs to, or 0.
+ */
+static const char *suffix[] = { "-journal", "-wal", "-shm", NULL };
+
+static void refresh (unsigned int i);
+
+static int
+database_of (const char *path, int length, int *kind)
+{
+	char base[PATH_MAX];
+	struct stat st;
+	int n, k;
+
+	for (k = 0; suffix[k]; k++)
+	{
+		n = strlen (suffix[k]);
+
+		if (length <= n || memcmp (path + length - n, suffix[k], n)) continue;
+
+		snprintf (base, PATH_MAX, "%.*s", length - n, path);
+
+		if (fstatat (srcfd, base, &st, AT_SYMLINK_NOFOLLOW) < 0 || !S_ISREG (st.st_mode)) return 0;
+
+		if (kind) *kind = suffix[k + 1] ? SIDECAR_LOG : SIDECAR_SHM;
+		return length - n;
+	}
+
+	return 0;
+}
+
+/* Note whether an entry belongs to a database, and if it is a journal or log
+ * that has changed, that the database has. Returns 1 when it belongs to one.
+ */
+static int
+classify (unsigned int i, int changed)
+{
+	struct entry *e = entry + i;
+	int length, kind = 0, base;
+
+	if (!(length = database_of (arena + e->path, e->length, &kind))) return (e->sidecar = 0);
+
+	e->sidecar = kind;
+	e->dirty = 0;
+
+	if (changed && kind == SIDECAR_LOG && (base = find (arena + e->path, length, 1)) >= 0)
+	{
+		entry[base].dirty = 1;
+		if (!entry[base].type) refresh (base);
+	}
+
+	return 1;
+}
+
+/* Look at an entry in the cache again, keeping the total size up to date */
+static void
+refresh (unsigned int i)
+{
+	struct entry *e = entry + i;
+	struct stat st;
+
+	status.bytes -= e->bytes;
+	e->written = 0;
+
+	if (fstatat (srcfd, path_of (i), &st, AT_SYMLINK_NOFOLLOW) < 0)
+		e->type = 0, e->bytes = 0;
+	else
+	{
+		e->type = S_ISDIR (st.st_mode) ? DT_DIR : S_ISLNK (st.st_mode) ? DT_LNK : DT_REG;
+		e->bytes = st.st_blocks * 512ULL;
+	}
+
+	status.bytes += e->bytes;
+}
+
+/* Look at the size of the files being written again, which Firefox keeps
+ * open, as its databases and their logs, so that they add up to the cache.
+ */
+static void
+resize (void)
+{
+	unsigned int i;
+
+	for (i = 0; written && i < entries; i++)
+		if (entry[i].written) refresh (i);
+
+	written = 0;
+	resized = genmon_nanos ();
+}
+
+/* The slot of a watch, or the empty one it would go in */
+static unsigned int
+watch_slot (int wd)
+{
+	unsigned int mask = MAXWATCHES * 2 - 1, slot = wd & mask;
+
+	while (watch[slot].wd && watch[slot].wd != wd) slot = (slot + 1) & mask;
+
+	return slot;
+}
+
+/* Note the entry a watch is on. Returns 0 when there is no room. */
+static int
+watch_add (int wd, unsigned int i)
+{
+	unsigned int slot = watch_slot (wd);
+
+	if (!watch[slot].wd)
+	{
+		if (watches >= MAXWATCHES) return 0;
+
+		watches++;
+	}
+
+	watch[slot].wd = wd;
+	watch[slot].entry = i;
+
+	return 1;
+}
+
+/* Forget a watch. Those after it in its run that may go in its place are moved
+ * back, so that no lookup stops short at the gap.
+ */
+static void
+watch_remove (int wd)
+{
+	unsigned int mask = MAXWATCHES * 2 - 1, slot = watch_slot (wd), next;
+
+	if (!watch[slot].wd) return;
+
+	watch[slot].wd = 0;
+	watches--;
+
+	for (next = (slot + 1) & mask; watch[next].wd; next = (next + 1) & mask)
+	{
+		if (((next - watch[next].wd) & mask) < ((next - slot) & mask)) continue;
+
+		watch[slot] = watch[next];
+		watch[next].wd = 0;
+		slot = next;
+	}
+}
+
+static void
+add_watch (unsigned int i)
+{
+	int wd = inotify_add_watch (inotifyfd, path_of (i), IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE
+		| IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW);
+
+	if (wd < 0 || watch_add (wd, i)) return;
+
+	if (debug) fprintf (stderr, "%s: %s: too many directories to watch\n", prog, path_of (i));
+	inotify_rm_watch (inotifyfd, wd);
+}
+
+/* Whether the disk copy of an entry differs, by type, size and modification
+ * time as rsync judges it.
+ */
+static int
+differs (unsigned int i)
+{
+	struct stat src, dst;
+
+	if (fstatat (dstfd, path_of (i), &dst, AT_SYMLINK_NOFOLLOW) < 0) return 1;
+	if (fstatat (srcfd, path_of (i), &src, AT_SYMLINK_NOFOLLOW) < 0) return 1;
+
+	if ((src.st_mode & S_IFMT) != (dst.st_mode & S_IFMT)) return 1;
+	if (S_ISDIR (src.st_mode)) return 0;
+
+	/* A database with a journal or log in the disk copy, as rsync left them */
+	char side[PATH_MAX];
+	int k;
+
+	for (k = 0; suffix[k + 1]; k++)
+	{
+		snprintf (side, PATH_MAX, "%s%s", path_of (i), suffix[k]);
+		if (fstatat (dstfd, side, &dst, AT_SYMLINK_NOFOLLOW) == 0) return 1;
+	}
+
+	return src.st_size != dst.st_size || src.st_mtim.tv_sec != dst.st_mtim.tv_sec
+		|| src.st_mtim.tv_nsec != dst.st_mtim.tv_nsec;
+}
+
+/* Walk a directory of the cache, watching each directory in it. With check
+ * set, entries whose disk copy differs are marked dirty, otherwise all are.
+ */
+static void
+walk (unsigned int dir, int check)
+{
+	char path[PATH_MAX];
+	struct dirent *d;
+	DIR *dp;
+	int fd, i;
+
+	add_watch (dir);
+
+	if ((fd = openat (srcfd, path_of (dir), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) < 0) return;
+	if (!(dp = fdopendir (fd)))
+	{
+		close (fd);
+		return;
+	}
+
+	while ((d = readdir (dp)))
+	{
+		if (!strcmp (d->d_name, ".") || !strcmp (d->d_name, "..") || is_excluded (d->d_name)) continue;
+
+		int length = snprintf (path, PATH_MAX, "%s%s%s", arena + entry[dir].path, entry[dir].length ? "/" : "", d->d_name);
+
+		if ((i = find (path, length, 1)) < 0) break;
+
+		refresh (i);
+		if (classify (i, 1)) continue;
+
+		if (!check || differs (i)) entry[i].dirty = 1;
+
+		if (entry[i].type == DT_DIR) walk (i, check);
+	}
+
+	closedir (dp);
+}
+
+/* Walk a directory of the disk copy for what is no longer in the cache */
+static void
+walk_disk (const char *dir)
+{
+	char path[PATH_MAX];
+	struct dirent *d;
+	DIR *dp;
+	int fd, i;
+
+	if ((fd = openat (dstfd, *dir ? dir : ".", O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) < 0) return;
+	if (!(dp = fdopendir (fd)))
+	{
+		close (fd);
+		return;
+	}
+
+	while ((d = readdir (dp)))
+	{
+		if (!strcmp (d->d_name, ".") || !strcmp (d->d_name, "..")) continue;
+
+		int length = snprintf (path, PATH_MAX, "%s%s%s", dir, *dir ? "/" : "", d->d_name);
+
+		/* Journals and logs go when their database is next copied */
+		if (database_of (path, length, NULL)) continue;
+
+		/* Excluded files are deleted from the disk copy, as rsync --delete-excluded does */
+		if ((i = find (path, length, 0)) < 0 || !entry[i].type)
+		{
+			if ((i = find (path, length, 1)) < 0) break;
+			entry[i].dirty = 1;
+		}
+		else if (entry[i].type == DT_DIR && d->d_type == DT_DIR)
+			walk_disk (path);
+	}
+
+	closedir (dp);
+}
+
+/* Start again from the directories themselves, as at startup or when events
+ * have been lost. Only once the daemon has seen the cache does anything get
+ * deleted from the disk copy, so a cache that was never filled, say, cannot
+ * empty it.
+ */
+static void
+scan (int deletions)
+{
+	if (debug) fprintf (stderr, "%s: scanning %s\n", prog, srcpath);
+
+	memset (table, 0, sizeof (table));
+	memset (watch, 0, sizeof (watch));
+	entries = arenalen = watches = 0;
+	status.bytes = 0;
+	rescan = 0;
+
+	refresh (find ("", 0, 1));
+	walk (0, 1);
+	if (deletions) walk_disk ("");
+}
+
+/* Remove a file or a directory tree from the disk copy */
+static void
+remove_disk (int dirfd, const char *path)
+{
+	struct dirent *d;
+	DIR *dp;
+	int fd;
+
+	if (!unlinkat (dirfd, path, 0) || errno == ENOENT) return;
+
+	if ((fd = openat (dirfd, path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) >= 0)
+	{
+		if ((dp = fdopendir (fd)))
+		{
+			while ((d = readdir (dp)))
+				if (strcmp (d->d_name, ".") && strcmp (d->d_name, "..")) remove_disk (fd, d->d_name);
+
+			closedir (dp);
+		}
+		else close (fd);
+	}
+
+	unlinkat (dirfd, path, AT_REMOVEDIR);
+}
+
+/* Make the directories leading to a path in the disk copy */
+static void
+make_parents (const char *path)
+{
+	char parent[PATH_MAX], *slash;
+
+	snprintf (parent, PATH_MAX, "%s", path);
+
+	for (slash = parent; (slash = strchr (slash, '/')); *slash++ = '/')
+	{
+		*slash = '\0';
+		mkdirat (dstfd, parent, 0700);
+	}
+}
+
+/* Copy the data of a file by sharing its blocks when the filesystem can, or
+ * else in the kernel with copy_file_range, or else through a buffer.
+ */
+static int
+copy_data (int in, int out, off_t size)
+{
+	static char buffer[65536];
+	ssize_t n, w;
+
+	if (!ioctl (out, FICLONE, in)) return 0;
+
+	while (size > 0 && (n = copy_file_range (in, NULL, out, NULL, size, 0)) > 0) size -= n;
+
+	if (size <= 0) return 0;
+
+	if (n < 0 && errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP) return -1;
+
+	/* Whatever copy_file_range did not, from where it got to */
+	while ((n = read (in, buffer, sizeof (buffer))) > 0)
+		for (char *p = buffer; n > 0; p += w, n -= w)
+			if ((w = write (out, p, n)) < 0) return -1;
+
+	return (n < 0) ? -1 : 0;
+}
+
+/* Remove the journal and log of a database from the disk copy, which are
+ * either stale or went with the database.
+ */
+static void
+remove_sidecars (const char *path)
+{
+	char side[PATH_MAX];
+	int k;
+
+	for (k = 0; suffix[k]; k++)
+	{
+		snprintf (side, PATH_MAX, "%s%s", path, suffix[k]);
+		unlinkat (dstfd, side, 0);
+	}
+}
+
+/* Mix bytes in to a key, as FNV-1a does */
+static unsigned long long int
+key_add (unsigned long long int key, const void *data, int length)
+{
+	const unsigned char *p = data;
+
+	while (length--) key = (key ^ *p++) * 1099511628211ULL;
+
+	return key;
+}
+
+/* What identifies the contents of a database: the change counter and page
+ * count in its header and its modification time, and the size, checkpoint
+ * sequence, salts and modification time of its log. Once a checkpoint has
+ * reset the log, commits write it again from the start without making it
+ * longer, and only the first of them changes the salts, so the header of the
+ * wal-index in the -shm file is taken too, which every commit changes. The
+ * same value means the disk copy is still good.
+ */
+static unsigned long long int
+database_key (const char *path, const unsigned char *header, const struct stat *st)
+{
+	unsigned char walheader[32] = { 0 }, index[48] = { 0 };
+	unsigned long long int key = 14695981039346656037ULL;
+	char side[PATH_MAX];
+	struct stat wal = { 0 };
+	int fd;
+
+	snprintf (side, PATH_MAX, "%s-wal", path);
+
+	if ((fd = openat (srcfd, side, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) >= 0)
+	{
+		if (fstat (fd, &wal) < 0 || pread (fd, walheader, sizeof (walheader), 0) < 0) memset (&wal, 0, sizeof (wal));
+		close (fd);
+	}
+
+	snprintf (side, PATH_MAX, "%s-shm", path);
+
+	if ((fd = openat (srcfd, side, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) >= 0)
+	{
+		if (pread (fd, index, sizeof (index), 0) < 0) memset (index, 0, sizeof (index));
+		close (fd);
+	}
+
+	key = key_add (key, header + 24, 8);
+	key = key_add (key, &st->st_mtim, sizeof (st->st_mtim));
+	key = key_add (key, walheader + 12, 12);
+	key = key_add (key, &wal.st_size, sizeof (wal.st_size));
+	key = key_add (key, &wal.st_mtim, sizeof (wal.st_mtim));
+
+	return key_add (key, index, sizeof (index));
+}
+
+/* Copy a database with the SQLite backup API, which reads it under a shared
+ * lock, so that the copy is of a committed state, whatever Firefox is doing
+ * to it and whatever is still only in its log. One that is locked for longer
+ * than the busy timeout, as places.sqlite is by Firefox using exclusive
+ * locking, stays dirty and is tried again at the next sync.
+ */
+static int
+copy_database (unsigned int i, const char *temp, const unsigned char *header, const struct stat *st)
+{
+	const char *path = path_of (i);
+	unsigned long long int key = database_key (path, header, st);
+	char dst[PATH_MAX];
+	struct timespec times[2];
+	sqlite3 *from = NULL, *to = NULL;
+	sqlite3_backup *backup;
+	int ret = -1;
+
+	if (entry[i].snapshot == key)
+	{
+		remove_sidecars (path);
+		return 0;
+	}
+
+	/* The cache is the working directory, the disk copy is not, and a path
+	 * cut short would name another file.
+	 */
+	if (snprintf (dst, PATH_MAX, "%s/%s", dstroot, temp) >= PATH_MAX) return -1;
+	unlinkat (dstfd, temp, 0);
+
+	if (sqlite3_open_v2 (path, &from, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK
+		&& sqlite3_open_v2 (dst, &to, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) == SQLITE_OK)
+	{
+		sqlite3_busy_timeout (from, 1000);
+
+		if ((backup = sqlite3_backup_init (to, "main", from, "main")))
+		{
+			sqlite3_backup_step (backup, -1);
+			if (sqlite3_backup_finish (backup) == SQLITE_OK) ret = 0;
+		}
+
+		if (ret < 0 && debug) fprintf (stderr, "%s: %s: %s\n", prog, path, sqlite3_errmsg (to));
+	}
+	else if (debug) fprintf (stderr, "%s: %s: cannot open\n", prog, path);
+
+	sqlite3_close (from);
+	sqlite3_close (to);
+
+	if (ret == 0)
+	{
+		times[0] = st->st_atim;
+		times[1] = st->st_mtim;
+
+		fchmodat (dstfd, temp, st->st_mode & 07777, 0);
+		utimensat (dstfd, temp, times, 0);
+
+		if (renameat (dstfd, temp, dstfd, path) < 0)
+		{
+			remove_disk (dstfd, path);
+			ret = renameat (dstfd, temp, dstfd, path);
+		}
+	}
+
+	if (ret < 0)
+	{
+		unlinkat (dstfd, temp, 0);
+		return -1;
+	}
+
+	remove_sidecars (path);
+	entry[i].snapshot = key;
+
+	return 0;
+}
+
+/* Copy a file of the cache to a temporary file beside its disk copy, and
+ * rename it in to place once it is complete. Databases are copied whole.
+ */
+static int
+copy_file (unsigned int i)
+{
+	static const char magic[16] = "SQLite format 3";
+	const char *path = path_of (i);
+	unsigned char header[100];
+	char temp[PATH_MAX];
+	struct timespec times[2];
+	struct stat st;
+	int in, out, ret = -1;
+	const char *name = strrchr (path, '/');
+
+	if (snprintf (temp, PATH_MAX, "%.*s.%s.ffpcsyncd~", name ? (int)(name - path + 1) : 0, path, name ? name + 1 : path) >= PATH_MAX)
+		return -1;
+
+	if ((in = openat (srcfd, path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) < 0) return -1;
+	if (fstat (in, &st) < 0) goto done;
+
+	if (pread (in, header, sizeof (header), 0) == sizeof (header) && !memcmp (header, magic, sizeof (magic)))
+	{
+		make_parents (path);
+		ret = copy_database (i, temp, header, &st);
+		goto done;
+	}
+
+	if ((out = openat (dstfd, temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) < 0 && errno == ENOENT)
+	{
+		make_parents (path);
+		out = openat (dstfd, temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	}
+	if (out < 0) goto done;
+
+	if (copy_data (in, out, st.st_size) == 0)
+	{
+		times[0] = st.st_atim;
+		times[1] = st.st_mtim;
+
+		fchmod (out, st.st_mode & 07777);
+		futimens (out, times);
+
+		ret = 0;
+	}
+	close (out);
+
+	if (ret == 0 && renameat (dstfd, temp, dstfd, path) < 0)
+	{
+		/* A directory of the same name is in the way */
+		remove_disk (dstfd, path);
+		ret = renameat (dstfd, temp, dstfd, path);
+	}
+
+	if (ret < 0) unlinkat (dstfd, temp, 0);
+
+done:
+	close (in);
+	return ret;
+}
+
+static void
+copy_link (const char *path)
+{
+	char target[PATH_MAX];
+	ssize_t n;
+
+	if ((n = readlinkat (srcfd, path, target, PATH_MAX - 1)) < 0) return;
+	target[n] = '\0';
+
+	remove_disk (dstfd, path);
+
+	if (symlinkat (target, dstfd, path) < 0 && errno == ENOENT)
+	{
+		make_parents (path);
+		symlinkat (target, dstfd, path);
+	}
+}
+
+/* Drop the entries that are gone from the cache and have been deleted from
+ * the disk copy, so that the table does not fill with temporary files.
+ */
+static void
+compact (void)
+{
+	static unsigned int moved[MAXENTRIES];
+	static struct watch old[MAXWATCHES * 2];
+	unsigned int i, n = 0, mask = MAXENTRIES * 2 - 1, slot, length = 0;
+
+	memset (table, 0, sizeof (table));
+
+	for (i = 0; i < entries; i++)
+	{
+		moved[i] = MAXENTRIES;
+		if (!entry[i].type && !entry[i].dirty) continue;
+
+		moved[i] = n;
+		entry[n] = entry[i];
+
+		memmove (arena + length, arena + entry[n].path, entry[n].length + 1);
+		entry[n].path = length;
+		length += entry[n].length + 1;
+
+		for (slot = hash (arena + entry[n].path, entry[n].length) & mask; table[slot]; slot = (slot + 1) & mask);
+		table[slot] = ++n;
+	}
+
+	/* The watches follow their entries, those on entries gone are dropped */
+	memcpy (old, watch, sizeof (watch));
+	memset (watch, 0, sizeof (watch));
+	watches = 0;
+
+	for (i = 0; i < MAXWATCHES * 2; i++)
+		if (old[i].wd && moved[old[i].entry] < MAXENTRIES) watch_add (old[i].wd, moved[old[i].entry]);
+
+	entries = n;
+	arenalen = length;
+}
+
+/* Bring the disk copy up to date with what has changed. Deletions are done
+ * first, so that nothing of the same name is in the way of a copy.
+ */
+static void
+sync_disk (void)
+{
+	unsigned int i, copied = 0, deleted = 0;
+	unsigned long long int start = genmon_nanos ();
+	struct stat st;
+
+	if (rescan) scan (1);
+
+	resize ();
+
+	for (i = 1; i < entries; i++)
+		if (entry[i].dirty && !entry[i].type)
+		{
+			remove_disk (dstfd, path_of (i));
+			if (!entry[i].sidecar) remove_sidecars (path_of (i));
+			entry[i].dirty = 0;
+			deleted++;
+		}
+
+	for (i = 0; i < entries; i++)
+	{
+		if (!entry[i].dirty) continue;
+
+		switch (entry[i].type)
+		{
+		case DT_DIR:
+			if (mkdirat (dstfd, path_of (i), 0700) < 0 && errno == ENOENT)
+			{
+				make_parents (path_of (i));
+				mkdirat (dstfd, path_of (i), 0700);
+			}
+
+			if (fstatat (srcfd, path_of (i), &st, 0) == 0) fchmodat (dstfd, path_of (i), st.st_mode & 07777, 0);
+			break;
+
+		case DT_LNK:
+			copy_link (path_of (i));
+			break;
+
+		case DT_REG:
+			/* One that cannot be copied, as when deleted meanwhile, stays dirty
+			 * until its events say what became of it.
+			 */
+			if (copy_file (i) < 0) continue;
+			break;
+		}
+
+		entry[i].dirty = 0;
+		copied++;
+	}
+
+	compact ();
+
+	status.syncs++;
+	status.synced = time (NULL);
+
+	if (debug)
+		fprintf (stderr, "%s: copied %u, deleted %u in %lluus\n", prog, copied, deleted,
+			(genmon_nanos () - start) / 1000);
+}
+
+/* Handle a batch of inotify events. Returns 0 when the cache itself has gone,
+ * as on logout, and then nothing must be synced or the disk copy would be
+ * emptied too.
+ */
+static int
+read_events (void)
+{
+	static char buffer[65536] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+	char path[PATH_MAX];
+	ssize_t n;
+	char *p;
+	int i;
+
+	if ((n = read (inotifyfd, buffer, sizeof (buffer))) <= 0) return 1;
+
+	for (p = buffer; p < buffer + n; p += sizeof (struct inotify_event) + ((struct inotify_event *)p)->len)
+	{
+		struct inotify_event *event = (struct inotify_event *)p;
+
+		if (event->mask & IN_Q_OVERFLOW)
+		{
+			rescan = 1;
+			continue;
+		}
+
+		unsigned int slot = watch_slot (event->wd);
+
+		if (!watch[slot].wd) continue;
+
+		unsigned int dir = watch[slot].entry;
+
+		if (event->mask & (IN_DELETE_SELF | IN_UNMOUNT | IN_IGNORED))
+		{
+			if (dir == 0) return 0;
+
+			watch_remove (event->wd);
+			continue;
+		}
+
+		if (!event->len || is_excluded (event->name)) continue;
+
+		/* A directory that moves takes its watches and entries with it */
+		if ((event->mask & IN_ISDIR) && (event->mask & (IN_MOVED_FROM | IN_MOVED_TO)))
+		{
+			rescan = 1;
+			continue;
+		}
+
+		int length = snprintf (path, PATH_MAX, "%s%s%s", arena + entry[dir].path, entry[dir].length ? "/" : "", event->name);
+
+		if ((i = find (path, length, 1)) < 0) continue;
+
+		/* A file being written is only looked at again once it is closed, or
+		 * every so often while it is kept open.
+		 */
+		if (event->mask != IN_MODIFY) refresh (i);
+		else entry[i].written = written = 1;
+
+		if (classify (i, event->mask & (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO | IN_DELETE))) continue;
+
+		entry[i].dirty = 1;
+
+		if ((event->mask & IN_CREATE) && entry[i].type == DT_DIR) walk (i, 0);
+	}
+
+	return 1;
+}
+
+static void
+publish (void)
+{
+	unsigned int i;
+
+	for (i = status.dirty = 0; i < entries; i++) status.dirty += entry[i].dirty;
+
+	if (state) genmon_state_write (state, GENMON_FFPC, &status, sizeof (status));
+}
+
+static void
+on_signal (int sig)
+{
+	if (sig == SIGUSR1)	syncnow = 1;
+	else			quit = 1;
+}
+
+/* The daemon watching a cache, or 0 when there is none */
+static pid_t
+daemon_of (struct genmon_state **st, struct genmon_ffpc_state *ffpc, const char *name)
+{
+	if (!(*st = genmon_state_open (name, sizeof (*ffpc), 0))) return 0;
+
+	if (!genmon_state_read (*st, GENMON_FFPC, ffpc, sizeof (*ffpc)) || !ffpc->pid
+		|| (kill (ffpc->pid, 0) < 0 && errno == ESRCH))
+		return 0;
+
+	return ffpc->pid;
+}
+
+/* Ask the daemon to sync or to stop, and wait for it. Returns 1 when there
+ * is no daemon, and 3 when it did not sync or stop in time, so that the
+ * caller can sync another way.
+ */
+static int
+request (const char *name)
+{
+	struct genmon_ffpc_state ffpc;
+	struct genmon_state *st;
+	struct timespec tick = { 0, 10000000 };
+	unsigned int syncs;
+	pid_t pid;
+	int n, done = (mode == 'q');
+
+	if (!(pid = daemon_of (&st, &ffpc, name))) return 1;
+
+	syncs = ffpc.syncs;
+
+	if (mode == 's') kill (pid, SIGUSR1);
+	if (mode == 'k') kill (pid, SIGTERM);
+
+	/* A sync is done when the count goes up, a stop when the daemon is gone */
+	for (n = 0; !done && n < 12000; n++)
+	{
+		nanosleep (&tick, NULL);
+
+		if (mode == 'k' && kill (pid, 0) < 0 && errno == ESRCH) done = 1;
+		if (mode == 's' && genmon_state_read (st, GENMON_FFPC, &ffpc, sizeof (ffpc)) && ffpc.syncs != syncs) done = 1;
+	}
+
+	genmon_state_read (st, GENMON_FFPC, &ffpc, sizeof (ffpc));
+
+	/* In whole megabytes rounded up, as du -sm gives it */
+	printf ("size %llu\nsynced %lld\ndirty %u\n", (ffpc.bytes + 1048575) >> 20, ffpc.synced, ffpc.dirty);
+
+	if (done) return 0;
+
+	fprintf (stderr, "%s: daemon %d did not %s in time\n", prog, (int)pid, (mode == 'k') ? "stop" : "sync");
+	return 3;
+}
+
+int
+main (int argc, char *argv[])
+{
+	get_options (argc, argv);
+
+	struct genmon_ffpc_state ffpc;
+	struct genmon_state *st;
+	struct stat srcstat;
+	char name[64];
+
+	/* One daemon a cache, found by the device and inode of the directory */
+	if (stat (srcpath, &srcstat) < 0) return 1;
+	snprintf (name, 64, "ffpcsyncd.%llu.%llu", (unsigned long long int)srcstat.st_dev, (unsigned long long int)srcstat.st_ino);
+
+	if (mode) return request (name);
+
+	if (daemon_of (&st, &ffpc, name))
+	{
+		if (debug) fprintf (stderr, "%s: %s is watched already\n", prog, srcpath);
+		return 0;
+	}
+	if (st) genmon_state_close (st, sizeof (ffpc));
+
+	if ((srcfd = open (srcpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0
+		|| (dstfd = open (dstpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0
+		|| !realpath (dstpath, dstroot)
+		|| (inotifyfd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC)) < 0)
+	{
+		perror (prog);
+		return 1;
+	}
+
+	/* Paths of watches are relative to the cache */
+	if (fchdir (srcfd) < 0) return 1;
+
+	state = genmon_state_open (name, sizeof (status), 1);
+	status.pid = getpid ();
+
+	/* The signals only get through while waiting for events */
+	sigset_t block, wait;
+
+	sigemptyset (&block);
+	sigaddset (&block, SIGUSR1);
+	sigaddset (&block, SIGTERM);
+	sigaddset (&block, SIGINT);
+	sigaddset (&block, SIGHUP);
+	sigprocmask (SIG_BLOCK, &block, &wait);
+	sigdelset (&wait, SIGUSR1);
+	sigdelset (&wait, SIGTERM);
+	sigdelset (&wait, SIGINT);
+	sigdelset (&wait, SIGHUP);
+
+	signal (SIGUSR1, on_signal);
+	signal (SIGTERM, on_signal);
+	signal (SIGINT, on_signal);
+	signal (SIGHUP, on_signal);
+
+	/* Whatever differs already, as after a crash, is synced straight away */
+	scan (0);
+	sync_disk ();
+	publish ();
+
+	struct pollfd pfd = { inotifyfd, POLLIN, 0 };
+	struct timespec timeout = { RESIZE, 0 };
+
+	while (!quit)
+	{
+		if (ppoll (&pfd, 1, written ? &timeout : NULL, &wait) > 0 && !read_events ())
+		{
+			if (debug) fprintf (stderr, "%s: %s is gone\n", prog, srcpath);
+			status.pid = 0;
+			publish ();
+			return 0;
+		}
+
+		if (syncnow)
+		{
+			syncnow = 0;
+			sync_disk ();
+		}
+		else if (written && genmon_nanos () - resized >= RESIZE * 1000000000ULL)
+			resize ();
+
+		publish ();
+	}
+
+	/* Stopped, as at logout, so the disk copy is brought up to date */
+	sync_disk ();
+	status.pid = 0;
+	publish ();
+
+	return 0;
+}
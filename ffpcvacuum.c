@@ -0,0 +1,285 @@
+/*
+ * ffpcvacuum.c - Firefox profile database maintenance for ffpcsync.
+ * Copyright (C) 2013 Digirium, see <https://github.com/Digirium/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+static char *prog = "ffpcvacuum";
+static char *vers = "1.0.0";
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "genmon.h"
+
+/* Option parsing */
+static int debug = 0;
+static int dryrun = 0;
+static int jobs = 0;			/* 0 for one per CPU */
+static int threshold = 10;		/* percent of the pages free */
+
+#define MAXJOBS		64
+
+/* A database and what became of it */
+struct database
+{
+	const char *path;
+	int pages, freepages;
+	unsigned long long int before, after;	/* bytes, of the file and its log */
+	unsigned long long int nanos;
+	int vacuumed;
+	char error[128];			/* empty unless it failed */
+};
+
+static struct database *database;
+static unsigned int databases = 0, next = 0;
+
+static void
+show_version (void)
+{
+	printf ("%s %s - (C) 2013 Digirium, see <https://github.com/Digirium>\n", prog, vers);
+	printf ("Released under the GNU GPL.\n\n");
+}
+
+static void
+show_usage (void)
+{
+	printf ("Usage: %s [options] <database>...\n", prog);
+}
+
+static void
+show_help (void)
+{
+	show_version ();
+	show_usage ();
+
+	printf ("\n-d --debug		Display debugging output.\n");
+	printf ("-fN --free=N		Vacuum databases with at least N%% of their pages free (default 10).\n");
+	printf ("-h --help		Display this help.\n");
+	printf ("-jN --jobs=N		Work on N databases at once (default one per CPU).\n");
+	printf ("-n --dry-run		Only report how much of each database is free.\n");
+	printf ("-v --version		Display version information.\n");
+
+	printf ("\nVacuums and reindexes each database that is fragmented enough to be\n");
+	printf ("worth it, and reports the bytes reclaimed and the time taken. Firefox must\n");
+	printf ("not be using the databases.\n");
+	printf ("\nLong options may be passed with a single dash.\n\n");
+}
+
+static void
+get_options (int argc, char *argv[])
+{
+	static struct option long_opts[] =
+	{
+		{ "debug",	no_argument,		0, 'd' },
+		{ "dry-run",	no_argument,		0, 'n' },
+		{ "free",	required_argument,	0, 'f' },
+		{ "help",	no_argument,		0, 'h' },
+		{ "jobs",	required_argument,	0, 'j' },
+		{ "version",	no_argument,		0, 'v' },
+		{ 0,0,0,0 }
+	};
+
+	int opt, opti;
+
+	while ((opt = getopt_long (argc, argv, "df:hj:nv", long_opts, &opti)))
+	{
+		if (opt == EOF) break;
+
+		switch (opt)
+		{
+		case 'd':	debug = 1;			break;
+		case 'f':	threshold = atoi (optarg);	break;
+		case 'j':	jobs = atoi (optarg);		break;
+		case 'n':	dryrun = 1;			break;
+
+		case 'h':
+			show_help ();
+			exit (0);
+
+		case 'v':
+			show_version ();
+			exit (0);
+
+		default:
+			exit (2);
+		}
+	}
+
+	if (optind >= argc)
+	{
+		show_usage ();
+		exit (2);
+	}
+}
+
+/* The size of a database with its write-ahead log, if it has one */
+static unsigned long long int
+database_bytes (const char *path)
+{
+	char wal[4096];
+	struct stat st;
+	unsigned long long int bytes = 0;
+
+	if (stat (path, &st) == 0) bytes += st.st_size;
+
+	snprintf (wal, sizeof (wal), "%s-wal", path);
+	if (stat (wal, &st) == 0) bytes += st.st_size;
+
+	return bytes;
+}
+
+/* The value of a pragma that returns a number, or -1 */
+static int
+pragma (sqlite3 *db, const char *name)
+{
+	char sql[64];
+	sqlite3_stmt *stmt;
+	int value = -1;
+
+	snprintf (sql, sizeof (sql), "PRAGMA %s", name);
+
+	if (sqlite3_prepare_v2 (db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
+	if (sqlite3_step (stmt) == SQLITE_ROW) value = sqlite3_column_int (stmt, 0);
+	sqlite3_finalize (stmt);
+
+	return value;
+}
+
+/* Measure how much of a database is free pages, and vacuum it when that is
+ * past the threshold.
+ */
+static void
+maintain (struct database *d)
+{
+	unsigned long long int start = genmon_nanos ();
+	sqlite3 *db = NULL;
+
+	d->before = d->after = database_bytes (d->path);
+
+	if (sqlite3_open_v2 (d->path, &db, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK)
+	{
+		snprintf (d->error, sizeof (d->error), "%s", db ? sqlite3_errmsg (db) : "cannot open");
+		goto done;
+	}
+
+	sqlite3_busy_timeout (db, 5000);
+
+	if ((d->pages = pragma (db, "page_count")) < 0 || (d->freepages = pragma (db, "freelist_count")) < 0)
+	{
+		snprintf (d->error, sizeof (d->error), "%s", sqlite3_errmsg (db));
+		goto done;
+	}
+
+	if (dryrun || !d->pages || d->freepages * 100LL < (long long int)d->pages * threshold) goto done;
+
+	if (sqlite3_exec (db, "VACUUM; REINDEX", NULL, NULL, NULL) != SQLITE_OK)
+	{
+		snprintf (d->error, sizeof (d->error), "%s", sqlite3_errmsg (db));
+		goto done;
+	}
+
+	d->vacuumed = 1;
+
+done:
+	/* Closing the last connection checkpoints the log in to the database */
+	sqlite3_close (db);
+
+	if (d->vacuumed) d->after = database_bytes (d->path);
+	d->nanos = genmon_nanos () - start;
+
+	if (debug) fprintf (stderr, "%s: %s done in %lluus\n", prog, d->path, d->nanos / 1000);
+}
+
+static void *
+worker (void *arg)
+{
+	unsigned int i;
+
+	while ((i = __atomic_fetch_add (&next, 1, __ATOMIC_RELAXED)) < databases) maintain (database + i);
+
+	return arg;
+}
+
+int
+main (int argc, char *argv[])
+{
+	get_options (argc, argv);
+
+	pthread_t thread[MAXJOBS];
+	unsigned long long int start = genmon_nanos (), before = 0, after = 0;
+	unsigned int i, vacuumed = 0, failed = 0;
+	int n;
+
+	databases = argc - optind;
+
+	if (!(database = calloc (databases, sizeof (struct database))))
+	{
+		perror (prog);
+		return 1;
+	}
+
+	for (i = 0; i < databases; i++) database[i].path = argv[optind + i];
+
+	/* The pool is no bigger than the work, the first worker is this thread */
+	if (jobs <= 0) jobs = sysconf (_SC_NPROCESSORS_ONLN);
+	if (jobs > MAXJOBS) jobs = MAXJOBS;
+	if (jobs > (int)databases) jobs = databases;
+	if (jobs < 1) jobs = 1;
+
+	for (n = 1; n < jobs; n++)
+		if (pthread_create (thread + n, NULL, worker, NULL)) break;
+
+	worker (NULL);
+
+	while (--n > 0) pthread_join (thread[n], NULL);
+
+	for (i = 0; i < databases; i++)
+	{
+		struct database *d = database + i;
+
+		before += d->before;
+		after += d->after;
+
+		if (d->error[0])
+		{
+			printf ("  %-50s failed: %s\n", d->path, d->error);
+			failed++;
+		}
+		else if (d->vacuumed)
+		{
+			printf ("  %-50s %.2fMB -> %.2fMB, %.2fMB reclaimed in %llums\n", d->path,
+				d->before / 1048576.0, d->after / 1048576.0,
+				((long long int)d->before - (long long int)d->after) / 1048576.0, d->nanos / 1000000);
+			vacuumed++;
+		}
+		else
+		{
+			printf ("  %-50s %.2fMB, %d%% free, %s\n", d->path, d->before / 1048576.0,
+				d->pages ? (int)(d->freepages * 100LL / d->pages) : 0, dryrun ? "not vacuumed" : "skipped");
+		}
+	}
+
+	printf ("Total %.2fMB -> %.2fMB, %.2fMB reclaimed from %u of %u databases in %llums\n",
+		before / 1048576.0, after / 1048576.0, ((long long int)before - (long long int)after) / 1048576.0,
+		vacuumed, databases, (genmon_nanos () - start) / 1000000);
+
+	return failed ? 1 : 0;
+}
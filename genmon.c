@@ -0,0 +1,1846 @@
+/*
+ * genmon.c - Shared sampling code for the XFCE genmon plugin monitors.
+ * Copyright (C) 2013 Digirium, see <https://github.com/Digirium/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/nvme_ioctl.h>
+#include <linux/rtnetlink.h>
+#include <libgen.h>
+#include <limits.h>
+#include <net/if.h>
+#include <poll.h>
+#include <scsi/sg.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "genmon.h"
+
+unsigned long long int
+genmon_nanos (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC_RAW, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* The root the files are under, "" for the running system */
+const char *
+genmon_root (void)
+{
+	static const char *root = NULL;
+
+	if (!root && !(root = getenv ("GENMON_ROOT"))) root = "";
+
+	return root;
+}
+
+const char *
+genmon_path (const char *path)
+{
+	static char buffer[4][PATH_MAX];
+	static unsigned int next = 0;
+	const char *root = genmon_root ();
+	char *rooted;
+
+	if (!*root || *path != '/') return path;
+
+	rooted = buffer[next++ % 4];
+	snprintf (rooted, PATH_MAX, "%s%s", root, path);
+
+	return rooted;
+}
+
+/* The number of CPUs configured. Under a root it is taken from the capture,
+ * where sysconf would count those of the running system.
+ */
+int
+genmon_cpus (void)
+{
+	char buffer[64], *p;
+	int fd, len;
+
+	if (!*genmon_root ()) return sysconf (_SC_NPROCESSORS_CONF);
+
+	/* A list of ranges, as 0-511 or 0,2-3 */
+	if ((fd = open (genmon_path ("/sys/devices/system/cpu/present"), O_RDONLY)) < 0) return 1;
+	len = read (fd, buffer, sizeof (buffer) - 1);
+	close (fd);
+
+	if (len <= 0) return 1;
+	buffer[len] = '\0';
+
+	for (p = buffer + len; p > buffer && (unsigned)(p[-1] - '0') >= 10; p--);
+	for (; p > buffer && (unsigned)(p[-1] - '0') < 10; p--);
+
+	return atoi (p) + 1;
+}
+
+/* The pseudo-files are read in to this buffer and parsed in place, with no
+ * stdio and no allocation. It is big enough for /proc/stat with 1024 CPUs and
+ * /proc/net/dev with a couple of thousand interfaces, pages of it are only
+ * touched as far as a file reaches.
+ */
+static char procbuf[GENMON_PROCBUF + 16];
+
+/* Read a whole pseudo-file in to a buffer, normally with one read call. The
+ * contents are followed by eight NULs so the digit scanner can look ahead.
+ * A file larger than the buffer is cut short. Returns the length, or -1.
+ */
+int
+genmon_read_file (const char *path, char *buffer, int size)
+{
+	int fd, len = 0, n;
+
+	if ((fd = open (genmon_path (path), O_RDONLY)) < 0) return -1;
+
+	while (len < size - 9 && (n = read (fd, buffer + len, size - 9 - len)) > 0) len += n;
+	close (fd);
+
+	memset (buffer + len, 0, 9);
+
+	return len;
+}
+
+/* Read a pseudo-file in to the shared buffer for the caller to parse. The
+ * contents stay until the next call. Returns NULL on failure.
+ */
+const char *
+genmon_read_proc (const char *path)
+{
+	return (genmon_read_file (path, procbuf, sizeof (procbuf)) < 0) ? NULL : procbuf;
+}
+
+/* Skip blanks and parse an unsigned decimal number, leaving *pp after it.
+ * Runs of eight digits are converted at once, by testing and combining all
+ * the bytes of a 64 bit word in parallel.
+ */
+unsigned long long int
+genmon_scan (const char **pp)
+{
+	const unsigned char *p = (const unsigned char *)*pp;
+	unsigned long long int value = 0;
+
+	while (*p == ' ' || *p == '\t') p++;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	for (;;)
+	{
+		unsigned long long int chunk;
+
+		memcpy (&chunk, p, 8);
+
+		/* Every byte must be 0x30 to 0x39 */
+		if (((chunk & 0xF0F0F0F0F0F0F0F0ULL)
+			| (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+			!= 0x3333333333333333ULL)
+			break;
+
+		chunk = ((chunk & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+		chunk = ((chunk & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+		chunk = ((chunk & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32;
+
+		value = value * 100000000ULL + chunk;
+		p += 8;
+	}
+#endif
+
+	while ((unsigned)(*p - '0') < 10) value = value * 10 + (*p++ - '0');
+
+	*pp = (const char *)p;
+
+	return value;
+}
+
+static inline const char *
+next_line (const char *p)
+{
+	p = strchr (p, '\n');
+	return p ? p + 1 : NULL;
+}
+
+/* Parse the per CPU lines of /proc/stat, see genmon_read_stat */
+int
+genmon_parse_stat (const char *p, int cpus, unsigned long long int *total, unsigned long long int *idle)
+{
+	enum _PROC { User = 0, Nice, System, Idle };
+	unsigned long long int proc[4];
+	unsigned int id;
+	int i, n = 0;
+
+	memset (total, 0, cpus * sizeof (*total));
+	memset (idle, 0, cpus * sizeof (*idle));
+
+	/* The first line is the sum over all CPUs, skip it */
+	for (p = next_line (p); p && p[0] == 'c' && p[1] == 'p' && p[2] == 'u'; p = next_line (p))
+	{
+		p += 3;
+		id = genmon_scan (&p);
+
+		for (i = 0; i < 4; i++) proc[i] = genmon_scan (&p);
+
+		if (id >= (unsigned int)cpus) continue;
+
+		/* User + Nice + System + Idle */
+		total[id] = proc[User] + proc[Nice] + proc[System] + proc[Idle];
+		idle[id] = proc[Idle];
+		n++;
+	}
+
+	return n;
+}
+
+/* Parse the four values used by meminfo, see genmon_read_meminfo */
+int
+genmon_parse_meminfo (const char *p, struct genmond_mem *mem)
+{
+	int found = 0;
+
+	memset (mem, 0, sizeof (*mem));
+
+	for (; p && found < 4; p = next_line (p))
+	{
+		unsigned long long int *value;
+
+		if	(strncmp (p, "MemTotal:", 9) == 0)	value = &mem->total;
+		else if	(strncmp (p, "MemFree:", 8) == 0)	value = &mem->free;
+		else if	(strncmp (p, "Buffers:", 8) == 0)	value = &mem->buffers;
+		else if	(strncmp (p, "Cached:", 7) == 0)	value = &mem->cached;
+		else	continue;
+
+		p = strchr (p, ':') + 1;
+		*value = genmon_scan (&p);
+		found++;
+	}
+
+	return found;
+}
+
+/* Parse one interface line of /proc/net/dev, starting at p, in to its name
+ * and eight receive and eight transmit counters. Returns the start of the
+ * next line, or NULL at the end of the file. The name is left empty for the
+ * two header lines.
+ */
+const char *
+genmon_parse_netdev (const char *p, char *name, int size, unsigned long long int *rx, unsigned long long int *tx)
+{
+	const char *colon, *eol;
+	int i;
+
+	name[0] = '\0';
+
+	if (!*p) return NULL;
+
+	eol = strchr (p, '\n');
+
+	while (*p == ' ') p++;
+
+	if (!(colon = strchr (p, ':')) || (eol && colon > eol))
+		return eol ? eol + 1 : NULL;
+
+	i = colon - p;
+	if (i >= size) i = size - 1;
+	memcpy (name, p, i);
+	name[i] = '\0';
+
+	for (p = colon + 1, i = 0; i < 8; i++) rx[i] = genmon_scan (&p);
+	for (i = 0; i < 8; i++) tx[i] = genmon_scan (&p);
+
+	/* A last line without a newline still counts */
+	return eol ? eol + 1 : p + strlen (p);
+}
+
+/* Find the line of /proc/diskstats for a device number and parse up to n of
+ * its statistics. Returns the number parsed, 0 if the device is not listed.
+ */
+int
+genmon_parse_diskstats (const char *p, unsigned int major, unsigned int minor, unsigned long long int *stats, int n)
+{
+	int i;
+
+	for (; p && *p; p = next_line (p))
+	{
+		const char *q = p;
+
+		if (genmon_scan (&q) != major || genmon_scan (&q) != minor) continue;
+
+		/* Skip the device name */
+		while (*q == ' ') q++;
+		while (*q && *q != ' ' && *q != '\n') q++;
+
+		for (i = 0; i < n && *q == ' '; i++) stats[i] = genmon_scan (&q);
+
+		return i;
+	}
+
+	return 0;
+}
+
+/* Read the total (User + Nice + System + Idle) and idle jiffies of each
+ * CPU from /proc/stat, indexed by the N of its cpuN line. CPUs that are
+ * offline have no line and are left at zero. Returns the number read.
+ */
+int
+genmon_read_stat (int cpus, unsigned long long int *total, unsigned long long int *idle)
+{
+	if (genmon_read_file ("/proc/stat", procbuf, sizeof (procbuf)) < 0)
+	{
+		memset (total, 0, cpus * sizeof (*total));
+		memset (idle, 0, cpus * sizeof (*idle));
+		return 0;
+	}
+
+	return genmon_parse_stat (procbuf, cpus, total, idle);
+}
+
+/* Work out the usage of each CPU over the interval between two samples of
+ * /proc/stat, or -1 for a CPU that is offline. A CPU whose counters went
+ * backwards, having been unplugged in between, shows as idle.
+ */
+void
+genmon_cpu_usage (int cpus, const unsigned long long int *total, const unsigned long long int *idle,
+	const unsigned long long int *prevtotal, const unsigned long long int *previdle, signed char *percent)
+{
+	unsigned long long int intervaltotal, intervalidle;
+	int n;
+
+	for (n = 0; n < cpus; n++)
+	{
+		intervaltotal	= total[n] - prevtotal[n];
+		intervalidle	= idle[n] - previdle[n];
+
+		if (!total[n])
+			percent[n] = -1;
+		else if (total[n] <= prevtotal[n] || intervalidle > intervaltotal)
+			percent[n] = 0;
+		else
+			percent[n] = (100 * (intervaltotal - intervalidle)) / intervaltotal;
+	}
+}
+
+/* Work out the rate of a counter in units per second between two samples
+ * taken nanos apart, in 64 bit integer arithmetic with a 128 bit product, so
+ * it stays exact for any counter and any link speed. A counter that went
+ * backwards either wrapped, when both values fit in 32 bits as with some older
+ * drivers, or was reset by the interface going down and up. A wrap is only
+ * believed when the count it gives is one the counter could have made in the
+ * interval, otherwise it was a reset, which gives a rate of 0 as the time of
+ * the reset is not known. So does an interval too short to measure or so
+ * long, like a monitor that was not run for a while, that the average would
+ * mean little.
+ */
+static unsigned long long int
+counter_delta (unsigned long long int count, unsigned long long int prevcount, unsigned long long int nanos,
+	unsigned long long int maxrate)
+{
+	unsigned long long int delta;
+
+	if (count >= prevcount)		return count - prevcount;
+	if (prevcount > 0xFFFFFFFFULL)	return 0;
+
+	delta = count + 0x100000000ULL - prevcount;
+
+	return (unsigned __int128)delta * 1000000000ULL <= (unsigned __int128)maxrate * nanos ? delta : 0;
+}
+
+unsigned long long int
+genmon_rate (unsigned long long int count, unsigned long long int prevcount, unsigned long long int nanos)
+{
+	if (nanos < GENMON_RATE_MINNANOS || nanos > GENMON_RATE_MAXNANOS) return 0;
+
+	return (unsigned __int128)counter_delta (count, prevcount, nanos, GENMON_RATE_MAXWRAP) * 1000000000ULL / nanos;
+}
+
+/* Work out the load on a disk from two samples of its /proc/diskstats fields
+ * taken nanos apart. The await is the time spent on the requests completed in
+ * the interval over their number, the utilisation the share of the interval
+ * with requests in flight.
+ */
+void
+genmon_disk_io (const unsigned long long int *stats, const unsigned long long int *prevstats,
+	unsigned long long int nanos, struct genmon_diskio *io)
+{
+	enum _DISKSTATS { Reads = 0, ReadsMerged, SectorsRead, ReadTicks, Writes, WritesMerged,
+		SectorsWritten, WriteTicks, InFlight, IoTicks, TimeInQueue };
+
+	unsigned long long int ios, ticks;
+
+	memset (io, 0, sizeof (*io));
+
+	if (nanos < GENMON_RATE_MINNANOS || nanos > GENMON_RATE_MAXNANOS) return;
+
+	/* Sectors are always 512 bytes here */
+	io->readrate	= counter_delta (stats[SectorsRead], prevstats[SectorsRead], nanos, GENMON_DISK_MAXWRAP) * 512.0e9 / nanos;
+	io->writerate	= counter_delta (stats[SectorsWritten], prevstats[SectorsWritten], nanos, GENMON_DISK_MAXWRAP) * 512.0e9 / nanos;
+
+	ios	= counter_delta (stats[Reads], prevstats[Reads], nanos, GENMON_DISK_MAXWRAP)
+		+ counter_delta (stats[Writes], prevstats[Writes], nanos, GENMON_DISK_MAXWRAP);
+	ticks	= counter_delta (stats[ReadTicks], prevstats[ReadTicks], nanos, GENMON_DISK_MAXWRAP)
+		+ counter_delta (stats[WriteTicks], prevstats[WriteTicks], nanos, GENMON_DISK_MAXWRAP);
+
+	io->iops	= ios * 1000000000.0 / nanos;
+	io->await	= ios ? (float)ticks / ios : 0.0;
+	io->util	= counter_delta (stats[IoTicks], prevstats[IoTicks], nanos, GENMON_DISK_MAXWRAP) * 100000000.0 / nanos;
+
+	if (io->util > 100.0) io->util = 100.0;
+}
+
+/* Read a small sysfs attribute in to a buffer. Returns 0 on failure. */
+static int
+read_sysfs (const char *path, char *buffer, int size)
+{
+	int fd, len;
+
+	if ((fd = open (genmon_path (path), O_RDONLY)) < 0) return 0;
+
+	len = read (fd, buffer, size - 1);
+	close (fd);
+
+	if (len <= 0) return 0;
+
+	/* Drop the trailing newline */
+	if (buffer[len - 1] == '\n') len--;
+	buffer[len] = '\0';
+
+	return 1;
+}
+
+/* Find the physical package each CPU belongs to. Returns the number of
+ * packages.
+ */
+int
+genmon_cpu_packages (int cpus, short *package)
+{
+	char path[96], buffer[16];
+	int n, packages = 1;
+
+	for (n = 0; n < cpus; n++)
+	{
+		snprintf (path, 96, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", n);
+
+		package[n] = read_sysfs (path, buffer, 16) ? atoi (buffer) : 0;
+
+		if (package[n] < 0 || package[n] >= GENMON_MAXCPUS) package[n] = 0;
+		if (package[n] >= packages) packages = package[n] + 1;
+	}
+
+	return packages;
+}
+
+/* Look through the hwmon chips for the lowest numbered TYPE%d_input file of a
+ * chip named CHIP, whose label, or name without _input, is LABEL. Either may be
+ * "*" to match anything.
+ */
+static int
+hwmon_find (const char *type, const char *chip, const char *label, char *path, int size)
+{
+	char dir[64], file[128], buffer[64];
+	int hwmon, n;
+
+	for (hwmon = 0; hwmon < 64; hwmon++)
+	{
+		snprintf (dir, 64, "/sys/class/hwmon/hwmon%d", hwmon);
+		snprintf (file, 128, "%s/name", dir);
+
+		if (!read_sysfs (file, buffer, 64))
+		{
+			if (access (genmon_path (dir), F_OK)) break;	/* no more chips */
+			continue;
+		}
+
+		if (strcmp (chip, "*") && strcmp (chip, buffer)) continue;
+
+		for (n = 0; n < 32; n++)
+		{
+			snprintf (file, 128, "%s/%s%d_input", dir, type, n);
+			if (access (genmon_path (file), R_OK)) continue;
+
+			if (strcmp (label, "*"))
+			{
+				snprintf (file, 128, "%s/%s%d_label", dir, type, n);
+				if (!read_sysfs (file, buffer, 64)) snprintf (buffer, 64, "%s%d", type, n);
+
+				if (strcmp (label, buffer)) continue;
+			}
+
+			snprintf (path, size, "%s/%s%d_input", dir, type, n);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Find the hwmon files for the CPU temperature and fan speed. The choice can
+ * be set in ~/.genmon-sensors, with lines giving a value, a chip name and a
+ * label as listed by the sensors program, for example:
+ *
+ *	temp	k10temp		Tctl
+ *	fan	it8720		fan1
+ *
+ * Otherwise the temperature is taken from the first input of a known CPU
+ * sensor chip and the fan speed from the first fan found. Returns 0 if no
+ * temperature input was found.
+ */
+int
+genmon_hwmon_discover (struct genmon_hwmon *hwmon)
+{
+	static char *cpuchips[] = { "k10temp", "zenpower", "coretemp", "cpu_thermal", "acpitz", NULL };
+	char buffer[256], conf[256], type[16], chip[64], label[64];
+	char *home = getenv ("HOME");
+	int n;
+
+	strcpy (hwmon->temppath, "-");
+	strcpy (hwmon->fanpath, "-");
+
+	snprintf (conf, 256, "%s/.genmon-sensors", home ? home : "");
+
+	FILE *file = fopen (conf, "r");
+
+	if (file)
+	{
+		while (fgets (buffer, 256, file))
+		{
+			if (sscanf (buffer, "%15s %63s %63[^\n]", type, chip, label) != 3) continue;
+
+			if (strcmp (type, "temp") == 0 && hwmon->temppath[0] == '-')
+				hwmon_find ("temp", chip, label, hwmon->temppath, 128);
+
+			else if (strcmp (type, "fan") == 0 && hwmon->fanpath[0] == '-')
+				hwmon_find ("fan", chip, label, hwmon->fanpath, 128);
+		}
+		fclose (file);
+	}
+
+	for (n = 0; cpuchips[n] && hwmon->temppath[0] == '-'; n++)
+		hwmon_find ("temp", cpuchips[n], "*", hwmon->temppath, 128);
+
+	if (hwmon->fanpath[0] == '-')
+		hwmon_find ("fan", "*", "*", hwmon->fanpath, 128);
+
+	return hwmon->temppath[0] != '-';
+}
+
+/* Read an integer hwmon value. With fd given, the file is kept open in it
+ * between calls and read again from the start with pread. Returns 0 on
+ * failure.
+ */
+int
+genmon_hwmon_read (const char *path, int *fd, long *value)
+{
+	char buffer[32];
+	int myfd = fd ? *fd : -1, len;
+
+	if (myfd < 0 && (myfd = open (genmon_path (path), O_RDONLY)) < 0) return 0;
+
+	len = pread (myfd, buffer, 31, 0);
+
+	if (fd)	*fd = myfd;
+	else	close (myfd);
+
+	if (len <= 0) return 0;
+
+	buffer[len] = '\0';
+	*value = strtol (buffer, NULL, 10);
+
+	return 1;
+}
+
+int genmon_helper_wait = 250;	/* ms */
+long genmon_helper_maxrss = 0;	/* KB, of the runs whose output was used */
+
+/* The start time of a process, field 22 of /proc/PID/stat, which with its pid
+ * names it once and for all, as pids are reused. The name before it is in
+ * brackets and may hold anything, so the fields are counted from the last.
+ * It is of this system, not under any root. Returns 0 when there is no such
+ * process.
+ */
+static unsigned long long int
+pid_start (pid_t pid)
+{
+	char path[32], buffer[1024], *p;
+	int fd, len, field;
+
+	snprintf (path, sizeof (path), "/proc/%d/stat", (int)pid);
+
+	if ((fd = open (path, O_RDONLY)) < 0) return 0;
+
+	len = read (fd, buffer, sizeof (buffer) - 1);
+	close (fd);
+
+	if (len <= 0) return 0;
+	buffer[len] = '\0';
+
+	if (!(p = strrchr (buffer, ')'))) return 0;
+
+	/* The state, field 3, follows it */
+	for (field = 2; field < 22 && p; field++) p = strchr (p + 1, ' ');
+
+	return p ? strtoull (p + 1, NULL, 10) : 0;
+}
+
+/* Run a helper program in the background, or a call in place of one, and
+ * send its output to a pipe that genmon_helper reads. Never returns.
+ */
+static void
+helper_run (const char *command, int (*call) (const char *, char *, int), struct genmon_state *state,
+	struct genmon_helper_state *cache, int fd)
+{
+	char buffer[GENMON_HELPEROUT];
+	struct rusage usage;
+	FILE *file;
+	int null = open ("/dev/null", O_RDWR), len = 0, n, ok = 0;
+
+	/* Nothing of the caller's is kept open, the plugin reads the output of
+	 * a monitor until every copy of it is closed. Without a terminal sudo
+	 * fails rather than asks for a password.
+	 */
+	dup2 (null, STDIN_FILENO);
+	dup2 (null, STDOUT_FILENO);
+	dup2 (null, STDERR_FILENO);
+	fcntl (fd, F_SETFD, FD_CLOEXEC);
+	setsid ();
+	signal (SIGPIPE, SIG_IGN);
+
+	cache->pid = getpid ();
+	cache->start = pid_start (cache->pid);
+	genmon_state_write (state, GENMON_COMMAND, cache, sizeof (*cache));
+
+	if (call)
+	{
+		len = call (command, buffer, GENMON_HELPEROUT);
+		ok = (len > 0 && len < GENMON_HELPEROUT);
+
+		getrusage (RUSAGE_SELF, &usage);
+	}
+	else if ((file = popen (command, "r")))
+	{
+		while (len < GENMON_HELPEROUT - 1 && (n = fread (buffer + len, 1, GENMON_HELPEROUT - 1 - len, file)) > 0)
+			len += n;
+
+		/* The shell and all it ran have been waited for by now, so are
+		 * the children counted in the usage.
+		 */
+		ok = (pclose (file) == 0 && len);
+
+		getrusage (RUSAGE_CHILDREN, &usage);
+	}
+
+	/* A run that failed leaves the output of the last good one */
+	if (ok)
+	{
+		if (write (fd, buffer, len) < 0) {}
+
+		memcpy (cache->output, buffer, len);
+		cache->output[len] = '\0';
+		cache->len = len;
+		cache->maxrss = usage.ru_maxrss;
+		cache->nanos = genmon_nanos ();
+	}
+
+	cache->pid = 0;
+	cache->start = 0;
+	genmon_state_write (state, GENMON_COMMAND, cache, sizeof (*cache));
+
+	_exit (0);
+}
+
+/* Get the output of a helper program, run by the shell, in to output. It is
+ * waited for no more than genmon_helper_wait ms, when the output it left the
+ * last time is given instead, from the state file NAME. The run carries on
+ * in the background, and while it does no other is started. Given call, that
+ * is called with command in the background instead, to put its output in a
+ * buffer and return its length, or 0 on failure. Returns GENMON_FRESH,
+ * GENMON_STALE for output from an earlier run, or 0 if there is none.
+ */
+static int
+helper_call (const char *name, const char *command, int (*call) (const char *, char *, int), char *output, int size)
+{
+	struct genmon_helper_state cache;
+	struct genmon_state *state;
+	struct pollfd pfd;
+	unsigned long long int deadline = genmon_nanos () + genmon_helper_wait * 1000000ULL, now;
+	int fds[2], len = 0, n, ret = 0;
+	pid_t pid;
+
+	if (!(state = genmon_state_open (name, sizeof (cache), 1))) return 0;
+
+	if (!genmon_state_read (state, GENMON_COMMAND, &cache, sizeof (cache))) memset (&cache, 0, sizeof (cache));
+
+	/* A run still going is one whose pid was not since taken by another */
+	if (cache.pid && cache.start && pid_start (cache.pid) == cache.start) goto stale;
+
+	if (pipe (fds) < 0) goto stale;
+
+	/* The runner is left to init by a go-between, so a caller that stops
+	 * waiting for it has no zombie to reap.
+	 */
+	if ((pid = fork ()) == 0)
+	{
+		close (fds[0]);
+		if (fork () == 0) helper_run (command, call, state, &cache, fds[1]);
+		_exit (0);
+	}
+
+	close (fds[1]);
+	if (pid > 0) waitpid (pid, NULL, 0);
+
+	pfd.fd = fds[0];
+	pfd.events = POLLIN;
+
+	for (;;)
+	{
+		now = genmon_nanos ();
+
+		if (pid < 0 || now >= deadline) break;
+		if (poll (&pfd, 1, (deadline - now + 999999) / 1000000) <= 0) continue;
+
+		n = read (fds[0], output + len, size - 1 - len);
+
+		if (n < 0 && errno == EINTR) continue;
+		if (n > 0 && (len += n) < size - 1) continue;
+
+		/* A run that failed gives nothing at all */
+		if (n >= 0 && len) ret = GENMON_FRESH;
+		break;
+	}
+
+	close (fds[0]);
+
+	/* The runner closes the pipe only on exit, after it has left its usage */
+	if (ret)
+	{
+		output[len] = '\0';
+
+		if (genmon_state_read (state, GENMON_COMMAND, &cache, sizeof (cache)) && cache.maxrss > genmon_helper_maxrss)
+			genmon_helper_maxrss = cache.maxrss;
+
+		genmon_state_close (state, sizeof (cache));
+		return ret;
+	}
+
+stale:
+	if (cache.nanos)
+	{
+		snprintf (output, size, "%.*s", cache.len, cache.output);
+		if (cache.maxrss > genmon_helper_maxrss) genmon_helper_maxrss = cache.maxrss;
+		ret = GENMON_STALE;
+	}
+
+	genmon_state_close (state, sizeof (cache));
+	return ret;
+}
+
+int
+genmon_helper (const char *name, const char *command, char *output, int size)
+{
+	return helper_call (name, command, NULL, output, size);
+}
+
+/* Get the CPU temperature and PWM fan speed. These are read straight from
+ * the hwmon files in sysfs; only when there are none is the sensors program
+ * run, matching the labels written for an AMD Phenom(tm) II X4 965 (four
+ * cores) and an Intel Core 2 (two cores). A long running caller can pass in
+ * fds, two descriptors initialised to -1, to keep the files open. Returns
+ * GENMON_STALE when sensors was late and its last output was used.
+ */
+int
+genmon_read_sensors (int cpus, struct genmon_hwmon *hwmon, int *fds, float *temp, int *rpm)
+{
+	char output[GENMON_HELPEROUT], *buffer, *next;
+	long value;
+	int ret;
+
+	*temp = 0.0;
+	*rpm = 0;
+
+	if (!hwmon->temppath[0]) genmon_hwmon_discover (hwmon);
+
+	if (hwmon->temppath[0] != '-')
+	{
+		/* A file that went away, say after a driver reload, is looked for
+		 * again on the next run.
+		 */
+		if (genmon_hwmon_read (hwmon->temppath, fds, &value))
+			*temp = value / 1000.0;
+		else
+			hwmon->temppath[0] = '\0';
+
+		if (hwmon->fanpath[0] != '-')
+		{
+			if (genmon_hwmon_read (hwmon->fanpath, fds ? fds + 1 : NULL, &value))
+				*rpm = value;
+			else
+				hwmon->temppath[0] = '\0';
+		}
+
+		return GENMON_FRESH;
+	}
+
+	int phase = genmon_phase (GENMON_HELPER);
+
+	ret = genmon_helper ("helper.sensors", genmon_path ("/usr/bin/sensors"), output, sizeof (output));
+
+	genmon_phase (phase);
+
+	for (buffer = ret ? output : NULL; buffer; buffer = next)
+	{
+		if ((next = strchr (buffer, '\n'))) *next++ = '\0';
+
+		if (cpus == 4)
+		{
+			switch (buffer[0])
+			{
+			/* CPU temperature */
+			case 't':
+				if (strstr (buffer, "temp1:") == buffer)
+					sscanf (buffer, "temp1: +%f", temp);
+				break;
+
+			/* CPU Fan Speed */
+			case 'C':
+				if (strstr (buffer, "CPU Fan Speed:") == buffer)
+					sscanf (buffer, "CPU Fan Speed: %d RPM", rpm);
+				break;
+			}
+		}
+		else /* cpus == 2 */
+		{
+			/* CPU temperature */
+			if (strstr (buffer, "Core 0:") == buffer)
+				sscanf (buffer, "Core 0: +%f", temp);
+		}
+	}
+
+	return ret;
+}
+
+/* Get the four values used by meminfo from /proc/meminfo. Returns the
+ * number of values found.
+ */
+int
+genmon_read_meminfo (struct genmond_mem *mem)
+{
+	if (genmon_read_file ("/proc/meminfo", procbuf, sizeof (procbuf)) < 0)
+	{
+		memset (mem, 0, sizeof (*mem));
+		return 0;
+	}
+
+	return genmon_parse_meminfo (procbuf, mem);
+}
+
+/* Read the eight receive and eight transmit counters of an interface from
+ * /proc/net/dev. Returns 0 if the interface is not listed, i.e. it is down.
+ */
+int
+genmon_read_netdev (const char *interface, unsigned long long int *rx, unsigned long long int *tx)
+{
+	const char *p = procbuf;
+	char name[32];
+	int loop;
+
+	if (genmon_read_file ("/proc/net/dev", procbuf, sizeof (procbuf)) >= 0)
+		while ((p = genmon_parse_netdev (p, name, 32, rx, tx)))
+			if (strcmp (name, interface) == 0) return 1;
+
+	for (loop = 0; loop < 8; loop++) rx[loop] = tx[loop] = 0;
+
+	return 0;
+}
+
+/* Open a routing netlink socket for genmon_netlink_link. Returns -1 when
+ * netlink is not available, for example in a restricted sandbox, or under a
+ * root, when the counters come from its /proc/net/dev.
+ */
+int
+genmon_netlink_open (void)
+{
+	if (*genmon_root ()) return -1;
+
+	return socket (AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+}
+
+/* Get the 64 bit counters of one interface with an RTM_GETLINK request, and
+ * arrange them in the same order as the columns of /proc/net/dev. The link is
+ * asked for by *ifindex when it is set, which the kernel finds in constant time,
+ * otherwise by name, and *ifindex is updated from the reply. An index that now
+ * belongs to another interface is looked up again by name. Returns 1 if found,
+ * 0 if there is no such interface and -1 if the counters cannot be had this
+ * way, when the caller should fall back to genmon_read_netdev.
+ */
+int
+genmon_netlink_link (int fd, const char *name, int *ifindex, unsigned long long int *rx, unsigned long long int *tx)
+{
+	static unsigned int seq = 0;
+	static union { struct nlmsghdr nh; char buffer[32768]; } reply;
+
+	struct
+	{
+		struct nlmsghdr nh;
+		struct ifinfomsg ifi;
+		char attrs[RTA_SPACE (IFNAMSIZ)];
+	} req;
+
+	struct rtnl_link_stats64 stats;
+	struct nlmsghdr *nh;
+	struct rtattr *rta;
+	int tries, len, attrlen, found;
+	char *ifname;
+
+	if (fd < 0) return -1;
+
+	for (tries = 0; tries < 2; tries++)
+	{
+		memset (&req, 0, sizeof (req));
+		req.nh.nlmsg_len	= NLMSG_LENGTH (sizeof (req.ifi));
+		req.nh.nlmsg_type	= RTM_GETLINK;
+		req.nh.nlmsg_flags	= NLM_F_REQUEST;
+		req.nh.nlmsg_seq	= ++seq;
+		req.ifi.ifi_family	= AF_UNSPEC;
+		req.ifi.ifi_index	= *ifindex;
+
+		if (!*ifindex)
+		{
+			if (strlen (name) >= IFNAMSIZ) return 0;
+
+			rta = (struct rtattr *)((char *)&req + NLMSG_ALIGN (req.nh.nlmsg_len));
+			rta->rta_type = IFLA_IFNAME;
+			rta->rta_len = RTA_LENGTH (strlen (name) + 1);
+			strcpy (RTA_DATA (rta), name);
+			req.nh.nlmsg_len = NLMSG_ALIGN (req.nh.nlmsg_len) + RTA_ALIGN (rta->rta_len);
+		}
+
+		if (send (fd, &req, req.nh.nlmsg_len, 0) < 0) return -1;
+
+		/* The reply to a request for one link is a single message */
+		do	len = recv (fd, reply.buffer, sizeof (reply.buffer), MSG_TRUNC);
+		while (len < 0 && errno == EINTR);
+
+		if (len < 0 || len > (int)sizeof (reply.buffer)) return -1;
+
+		for (nh = &reply.nh, found = -1; NLMSG_OK (nh, len); nh = NLMSG_NEXT (nh, len))
+		{
+			if (nh->nlmsg_seq != seq) continue;
+
+			if (nh->nlmsg_type == NLMSG_ERROR)
+			{
+				int error = ((struct nlmsgerr *)NLMSG_DATA (nh))->error;
+
+				found = (error == -ENODEV) ? 0 : -1;
+				break;
+			}
+
+			if (nh->nlmsg_type != RTM_NEWLINK) continue;
+
+			struct ifinfomsg *ifi = NLMSG_DATA (nh);
+
+			ifname = NULL;
+			found = -1;
+			attrlen = IFLA_PAYLOAD (nh);
+
+			for (rta = IFLA_RTA (ifi); RTA_OK (rta, attrlen); rta = RTA_NEXT (rta, attrlen))
+			{
+				if (rta->rta_type == IFLA_IFNAME)
+					ifname = RTA_DATA (rta);
+
+				else if (rta->rta_type == IFLA_STATS64)
+				{
+					/* Older kernels send a shorter structure */
+					memset (&stats, 0, sizeof (stats));
+					memcpy (&stats, RTA_DATA (rta), RTA_PAYLOAD (rta) < sizeof (stats) ? RTA_PAYLOAD (rta) : sizeof (stats));
+					found = 1;
+				}
+			}
+
+			if (!ifname || strcmp (ifname, name)) found = 0;
+			else *ifindex = ifi->ifi_index;
+
+			break;
+		}
+
+		/* An interface that went away may have come back with a new index */
+		if (found == 0 && *ifindex)
+		{
+			*ifindex = 0;
+			continue;
+		}
+
+		if (found <= 0) return found;
+
+		/* The same sums the kernel makes for /proc/net/dev */
+		rx[0] = stats.rx_bytes;
+		rx[1] = stats.rx_packets;
+		rx[2] = stats.rx_errors;
+		rx[3] = stats.rx_dropped + stats.rx_missed_errors;
+		rx[4] = stats.rx_fifo_errors;
+		rx[5] = stats.rx_length_errors + stats.rx_over_errors + stats.rx_crc_errors + stats.rx_frame_errors;
+		rx[6] = stats.rx_compressed;
+		rx[7] = stats.multicast;
+
+		tx[0] = stats.tx_bytes;
+		tx[1] = stats.tx_packets;
+		tx[2] = stats.tx_errors;
+		tx[3] = stats.tx_dropped;
+		tx[4] = stats.tx_fifo_errors;
+		tx[5] = stats.collisions;
+		tx[6] = stats.tx_carrier_errors + stats.tx_aborted_errors + stats.tx_window_errors + stats.tx_heartbeat_errors;
+		tx[7] = stats.tx_compressed;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Find the block device of a filesystem from its device number. A block
+ * device is found straight away through /sys/dev/block/MAJ:MIN. Filesystems
+ * with an anonymous device number, btrfs for one, are looked for by number in
+ * the mount table. No mount point is ever stat()ed, so other mounts cannot slow
+ * it down, or hang it if they are dead NFS mounts. Returns 0 if none was found.
+ */
+int
+genmon_mount_device (dev_t dev, char *diskpath, int size)
+{
+	char path[64], real[PATH_MAX];
+	const char *p, *q, *eol;
+	int field;
+
+	snprintf (path, 64, "/sys/dev/block/%u:%u", major (dev), minor (dev));
+
+	if (realpath (genmon_path (path), real))
+	{
+		snprintf (diskpath, size, "/dev/%s", basename (real));
+		return 1;
+	}
+
+	/* Lines of mountinfo give the device number in the third field and the
+	 * source after the separator and the filesystem type.
+	 */
+	for (p = genmon_read_proc ("/proc/self/mountinfo"); p && *p; p = next_line (p))
+	{
+		q = p;
+		genmon_scan (&q);	/* mount ID */
+		genmon_scan (&q);	/* parent ID */
+
+		if (genmon_scan (&q) != major (dev) || *q++ != ':' || genmon_scan (&q) != minor (dev)) continue;
+
+		eol = strchr (q, '\n');
+		if (!(q = strstr (q, " - ")) || (eol && q > eol)) continue;
+
+		for (q += 3, field = 0; *q && *q != '\n' && field < 1; q++)
+			if (*q == ' ') field++;
+
+		if (*q != '/') continue;
+
+		for (field = 0; q[field] && q[field] != ' ' && q[field] != '\n'; field++);
+
+		snprintf (diskpath, size, "%.*s", field, q);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Get the current temperature of a disk and its model ID from hddtemp, which
+ * has a reference database for most HDDs. Its output looks like
+ * "/dev/sda: WDC WD10EARS-00Y5B1: 35°C". Under a root the stub left there by
+ * genmoncapture is run instead, without sudo. Returns 0 on failure, or
+ * GENMON_STALE when hddtemp was late and its last output was used.
+ */
+int
+genmon_read_hddtemp (const char *diskpath, char *id, int size, float *temp)
+{
+	char buffer[256], command[PATH_MAX + 300], name[80], *model, *value;
+	const char *disk = strrchr (diskpath, '/');
+	int ret;
+
+	if (*genmon_root ())	snprintf (command, sizeof (command), "%s %s", genmon_path ("/usr/bin/hddtemp"), diskpath);
+	else			snprintf (command, sizeof (command), "sudo hddtemp %s", diskpath);
+
+	snprintf (name, sizeof (name), "helper.hddtemp.%s", disk ? disk + 1 : diskpath);
+
+	int phase = genmon_phase (GENMON_HELPER);
+
+	ret = genmon_helper (name, command, buffer, sizeof (buffer));
+
+	genmon_phase (phase);
+	if (!ret) return 0;
+
+	if (!(model = strstr (buffer, ": "))) return 0;
+	model += 2;
+	if (!(value = strstr (model, ": "))) return 0;
+
+	*value = '\0';
+	value += 2;
+
+	snprintf (id, size, "%s", model);
+	*temp = atof (value);
+
+	return ret;
+}
+
+/* Find the whole disk a block device is on, for example sda for /dev/sda1,
+ * from where its sysfs entry sits. Returns 0 if it has no sysfs entry.
+ */
+int
+genmon_block_disk (const char *diskpath, char *disk, int size)
+{
+	char real[PATH_MAX], path[PATH_MAX + 32];
+
+	if (!realpath (genmon_path (diskpath), real)) return 0;
+
+	snprintf (path, sizeof (path), "/sys/class/block/%s", basename (real));
+	if (!realpath (genmon_path (path), real)) return 0;
+
+	/* A partition is a directory within its disk, already under the root */
+	snprintf (path, sizeof (path), "%s/partition", real);
+	if (access (path, F_OK) == 0) *strrchr (real, '/') = '\0';
+
+	snprintf (disk, size, "%s", basename (real));
+
+	return 1;
+}
+
+/* Get the device number of a disk, given its name as from genmon_block_disk.
+ * Returns 0 on failure.
+ */
+int
+genmon_block_devnum (const char *disk, unsigned int *major, unsigned int *minor)
+{
+	char path[128], buffer[32];
+	const char *p = buffer;
+
+	snprintf (path, 128, "/sys/class/block/%s/dev", disk);
+	if (!read_sysfs (path, buffer, 32)) return 0;
+
+	*major = genmon_scan (&p);
+	if (*p++ != ':') return 0;
+	*minor = genmon_scan (&p);
+
+	return 1;
+}
+
+/* Read the first GENMON_DISKSTATS fields of a device from /proc/diskstats.
+ * Returns 0 if it is not listed.
+ */
+int
+genmon_read_diskstats (unsigned int major, unsigned int minor, unsigned long long int *stats)
+{
+	memset (stats, 0, GENMON_DISKSTATS * sizeof (*stats));
+
+	if (genmon_read_file ("/proc/diskstats", procbuf, sizeof (procbuf)) < 0) return 0;
+
+	return genmon_parse_diskstats (procbuf, major, minor, stats, GENMON_DISKSTATS) > 0;
+}
+
+/* Look for a hwmon temperature input under a sysfs device directory. The
+ * drivetemp driver puts it in a hwmon subdirectory, nvme directly in the
+ * controller's directory.
+ */
+static int
+disk_hwmon (const char *dir, char *path, int size)
+{
+	struct dirent *entry;
+	char sub[PATH_MAX];
+	int found = 0;
+
+	DIR *d = opendir (genmon_path (dir));
+	if (!d) return 0;
+
+	while (!found && (entry = readdir (d)))
+	{
+		if (strncmp (entry->d_name, "hwmon", 5)) continue;
+
+		if (strcmp (entry->d_name, "hwmon") == 0)
+		{
+			snprintf (sub, sizeof (sub), "%s/hwmon", dir);
+			found = disk_hwmon (sub, path, size);
+			continue;
+		}
+
+		/* A path cut short would name another file */
+		if (snprintf (path, size, "%s/%s/temp1_input", dir, entry->d_name) >= size) continue;
+		found = (access (genmon_path (path), R_OK) == 0);
+	}
+	closedir (d);
+
+	return found;
+}
+
+/* Whether an ATA disk is in standby, by an ATA PASS-THROUGH (16) command for
+ * CHECK POWER MODE, which does not spin it up. The count register it returns
+ * is in the sense data, asked for with CK_COND, in either format. A disk that
+ * cannot tell is taken to be awake.
+ */
+static int
+ata_standby (int fd)
+{
+	unsigned char cdb[16] = { 0x85, 3 << 1, 0x20, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xe5, 0 };
+	unsigned char sense[32];
+	sg_io_hdr_t io;
+
+	memset (&io, 0, sizeof (io));
+	io.interface_id		= 'S';
+	io.dxfer_direction	= SG_DXFER_NONE;
+	io.cmd_len		= sizeof (cdb);
+	io.cmdp			= cdb;
+	io.mx_sb_len		= sizeof (sense);
+	io.sbp			= sense;
+	io.timeout		= 3000;	/* ms */
+
+	if (ioctl (fd, SG_IO, &io) < 0) return 0;
+
+	/* An ATA Status Return descriptor, or the fixed format information */
+	if ((sense[0] & 0x7f) == 0x72 && io.sb_len_wr >= 22 && sense[8] == 0x09)	return sense[13] == 0;
+	if ((sense[0] & 0x7f) == 0x70 && io.sb_len_wr >= 7)				return sense[6] == 0;
+
+	return 0;
+}
+
+/* Read the temperature from the SMART attributes of an ATA disk, with an ATA
+ * PASS-THROUGH (16) command for SMART READ DATA. Returns 0 on failure.
+ */
+static int
+smart_ata (int fd, float *temp)
+{
+	unsigned char cdb[16] = { 0x85, 4 << 1, 0x0e, 0, 0xd0, 0, 1, 0, 0, 0, 0x4f, 0, 0xc2, 0, 0xb0, 0 };
+	unsigned char data[512], sense[32];
+	sg_io_hdr_t io;
+	int n, found;
+
+	memset (&io, 0, sizeof (io));
+	io.interface_id		= 'S';
+	io.dxfer_direction	= SG_DXFER_FROM_DEV;
+	io.cmd_len		= sizeof (cdb);
+	io.cmdp			= cdb;
+	io.dxfer_len		= sizeof (data);
+	io.dxferp		= data;
+	io.mx_sb_len		= sizeof (sense);
+	io.sbp			= sense;
+	io.timeout		= 3000;	/* ms */
+
+	if (ioctl (fd, SG_IO, &io) < 0 || io.status) return 0;
+
+	/* Thirty attributes of twelve bytes from offset 2; Temperature_Celsius
+	 * (194), or else Airflow_Temperature_Cel (190), has it in the first byte
+	 * of the raw value.
+	 */
+	for (n = 0, found = 0; n < 30 && found != 194; n++)
+	{
+		unsigned char *attr = data + 2 + n * 12;
+
+		if (attr[0] == 194 || attr[0] == 190)
+		{
+			*temp = attr[5];
+			found = attr[0];
+		}
+	}
+
+	return found;
+}
+
+/* Read the composite temperature, in kelvin, from the SMART / Health log
+ * page of an NVMe drive. Returns 0 on failure.
+ */
+static int
+smart_nvme (int fd, float *temp)
+{
+	unsigned char data[512];
+	struct nvme_admin_cmd cmd;
+
+	memset (&cmd, 0, sizeof (cmd));
+	cmd.opcode	= 0x02;			/* Get Log Page */
+	cmd.nsid	= 0xffffffff;
+	cmd.addr	= (unsigned long)data;
+	cmd.data_len	= sizeof (data);
+	cmd.cdw10	= 0x02 | ((sizeof (data) / 4 - 1) << 16);
+
+	if (ioctl (fd, NVME_IOCTL_ADMIN_CMD, &cmd) != 0) return 0;
+
+	int kelvin = data[1] | (data[2] << 8);
+	if (!kelvin) return 0;
+
+	*temp = kelvin - 273;
+
+	return 1;
+}
+
+/* Read the temperature of a disk, its device path given, by SMART, as the
+ * call of a helper run in the background, since a disk may take seconds to
+ * answer. An ATA disk in standby is left there, as by smartctl -n standby,
+ * and given as "standby". Returns the length of the output, 0 on failure.
+ */
+static int
+smart_read (const char *devpath, char *output, int size)
+{
+	const char *disk = strrchr (devpath, '/') + 1;
+	float temp;
+	int fd, ret;
+
+	if ((fd = open (genmon_path (devpath), O_RDONLY | O_NONBLOCK)) < 0) return 0;
+
+	if (strncmp (disk, "nvme", 4) == 0)	ret = smart_nvme (fd, &temp);
+	else if (ata_standby (fd))		ret = -1;
+	else					ret = smart_ata (fd, &temp);
+
+	close (fd);
+
+	if (ret < 0)	return snprintf (output, size, "standby\n");
+	if (ret)	return snprintf (output, size, "%.1f\n", temp);
+
+	return 0;
+}
+
+/* Get the current temperature of a disk. The drivetemp or nvme hwmon input is
+ * read when there is one, which is cheap. Otherwise SMART is read straight from
+ * the device, which needs read access to it, and kept for ttl seconds; hddtemp
+ * is only the last resort. Both are run as helpers, and a disk in standby is
+ * not woken for either. The model is filled in to disktemp->id. Returns 0 if
+ * there is no temperature, GENMON_STALE if it is an old one as the disk or
+ * hddtemp was late.
+ */
+int
+genmon_read_disktemp (const char *diskpath, struct genmon_disktemp *disktemp, int ttl, float *temp)
+{
+	unsigned long long int nanos = genmon_nanos ();
+	char disk[64], path[PATH_MAX], name[80], output[64];
+	long value;
+	int ret = 0, standby = 0;
+
+	if (!disktemp->temppath[0])
+	{
+		strcpy (disktemp->temppath, "-");
+		disktemp->nanos = 0;
+
+		if (genmon_block_disk (diskpath, disk, 64))
+		{
+			snprintf (path, sizeof (path), "/sys/class/block/%s/device/model", disk);
+
+			if (!read_sysfs (path, disktemp->id, sizeof (disktemp->id)))
+				snprintf (disktemp->id, sizeof (disktemp->id), "%s", disk);
+
+			snprintf (path, sizeof (path), "/sys/class/block/%s/device", disk);
+			disk_hwmon (path, disktemp->temppath, sizeof (disktemp->temppath));
+		}
+	}
+
+	if (disktemp->temppath[0] != '-')
+	{
+		if (genmon_hwmon_read (disktemp->temppath, NULL, &value))
+		{
+			*temp = value / 1000.0;
+			return 1;
+		}
+
+		/* Look again next time, the drive may have been replaced */
+		disktemp->temppath[0] = '\0';
+	}
+
+	if (disktemp->nanos && nanos - disktemp->nanos < ttl * 1000000000ULL)
+	{
+		*temp = disktemp->temp;
+		return disktemp->temp != 0.0;
+	}
+
+	/* Failures are remembered for the ttl too, rather than retried each run */
+	disktemp->nanos = nanos;
+	disktemp->temp = 0.0;
+
+	/* The commands go to the whole disk, not a partition, and may wait for it
+	 * to spin up. Without read access to it, as for most users, they are not
+	 * tried at all.
+	 */
+	int phase = genmon_phase (GENMON_HELPER);
+
+	if (genmon_block_disk (diskpath, disk, 64))
+	{
+		snprintf (path, sizeof (path), "/dev/%s", disk);
+		snprintf (name, sizeof (name), "helper.smart.%s", disk);
+
+		/* Asleep, it has no temperature, and hddtemp is not run to wake it */
+		if (access (genmon_path (path), R_OK) == 0 && (ret = helper_call (name, path, smart_read, output, sizeof (output))))
+		{
+			if (strncmp (output, "standby", 7) == 0)	standby = 1;
+			else						disktemp->temp = atof (output);
+		}
+	}
+
+	if (!ret) ret = genmon_read_hddtemp (diskpath, disktemp->id, sizeof (disktemp->id), &disktemp->temp);
+
+	/* A late disk or hddtemp is asked again next time, its run in the
+	 * background should have left a fresh value by then.
+	 */
+	if (ret == GENMON_STALE) disktemp->nanos = 0;
+	if (standby) ret = 0;
+
+	genmon_phase (phase);
+
+	*temp = disktemp->temp;
+
+	return ret;
+}
+
+char *
+genmon_state_path (const char *name, char *path, int size)
+{
+	snprintf (path, size, "%s/dev/shm/genmon.%s.%d", genmon_root (), name, getuid ());
+	return path;
+}
+
+static struct genmon_state *
+state_open (const char *name, unsigned int size, int create)
+{
+	struct genmon_state *state;
+	unsigned int length = sizeof (*state) + size;
+	struct stat st;
+	char path[PATH_MAX];
+	int fd;
+
+	genmon_state_path (name, path, sizeof (path));
+
+	if ((fd = open (path, create ? O_RDWR | O_CREAT : O_RDONLY, 0600)) < 0) return NULL;
+
+	if (fstat (fd, &st) < 0) goto fail;
+
+	if (st.st_size != length)
+	{
+		if (!create) goto fail;
+
+		/* A file of another size was left by a different version. Replace it
+		 * rather than truncate it, anyone who still has it mapped keeps the
+		 * old file.
+		 */
+		if (st.st_size)
+		{
+			unlink (path);
+			close (fd);
+
+			if ((fd = open (path, O_RDWR | O_CREAT, 0600)) < 0) return NULL;
+		}
+
+		if (ftruncate (fd, length) < 0) goto fail;
+	}
+
+	state = mmap (NULL, length, PROT_READ | (create ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+	close (fd);
+
+	return (state == MAP_FAILED) ? NULL : state;
+
+fail:
+	close (fd);
+	return NULL;
+}
+
+/* Map the state file with the given name. With create set, the file is
+ * created if need be and mapped for writing, otherwise it is mapped read
+ * only and must already exist. Returns NULL on failure.
+ */
+struct genmon_state *
+genmon_state_open (const char *name, unsigned int size, int create)
+{
+	int phase = genmon_phase (GENMON_CACHE_READ);
+	struct genmon_state *state = state_open (name, size, create);
+
+	genmon_phase (phase);
+	return state;
+}
+
+static int
+state_read (struct genmon_state *state, unsigned int kind, void *record, unsigned int size)
+{
+	unsigned long long int seq;
+	int tries;
+
+	for (tries = 0; tries < 1000; tries++)
+	{
+		seq = __atomic_load_n (&state->seq, __ATOMIC_ACQUIRE);
+
+		if (seq & 1) continue;	/* a writer is busy */
+
+		if (state->magic != GENMON_STATE_MAGIC || state->version != GENMON_STATE_VERSION
+			|| state->kind != kind || state->size != size)
+			return 0;
+
+		memcpy (record, state + 1, size);
+		__atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n (&state->seq, __ATOMIC_RELAXED) == seq) return 1;
+	}
+
+	return 0;
+}
+
+/* Copy the record out of a state file. Returns 0 if there is no valid
+ * record of the given kind, for example the first time a monitor runs.
+ */
+int
+genmon_state_read (struct genmon_state *state, unsigned int kind, void *record, unsigned int size)
+{
+	int phase = genmon_phase (GENMON_CACHE_READ);
+	int ret = state_read (state, kind, record, size);
+
+	genmon_phase (phase);
+	return ret;
+}
+
+static int
+state_write (struct genmon_state *state, unsigned int kind, const void *record, unsigned int size)
+{
+	unsigned long long int seq = __atomic_load_n (&state->seq, __ATOMIC_RELAXED), lock;
+	unsigned int count = seq;
+
+	/* A writer that died holding the lock would keep it forever, take it over */
+	if ((count & 1) && kill (seq >> 32, 0) == 0) return 0;
+
+	count += 1 + (count & 1);
+	lock = (unsigned long long int)getpid () << 32 | count;
+
+	if (!__atomic_compare_exchange_n (&state->seq, &seq, lock, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		return 0;
+
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+
+	state->magic	= GENMON_STATE_MAGIC;
+	state->version	= GENMON_STATE_VERSION;
+	state->kind	= kind;
+	state->size	= size;
+
+	memcpy (state + 1, record, size);
+
+	__atomic_store_n (&state->seq, (unsigned int)(count + 1), __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+/* Copy a record in to a state file. Returns 0 without writing if another
+ * process holds the lock.
+ */
+int
+genmon_state_write (struct genmon_state *state, unsigned int kind, const void *record, unsigned int size)
+{
+	int phase = genmon_phase (GENMON_CACHE_WRITE);
+	int ret = state_write (state, kind, record, size);
+
+	genmon_phase (phase);
+	return ret;
+}
+
+void
+genmon_state_close (struct genmon_state *state, unsigned int size)
+{
+	int phase = genmon_phase (GENMON_CACHE_WRITE);
+
+	munmap (state, sizeof (*state) + size);
+	genmon_phase (phase);
+}
+
+/* The 95th percentile of up to 60 values, sorted in place */
+static float
+percentile95 (float *value, int n)
+{
+	int i, j;
+
+	if (!n) return 0.0;
+
+	for (i = 1; i < n; i++)
+	{
+		float v = value[i];
+
+		for (j = i; j > 0 && value[j - 1] > v; j--) value[j] = value[j - 1];
+		value[j] = v;
+	}
+
+	return value[(n * 95 - 1) / 100];
+}
+
+static void
+slot_add (struct genmon_history_slot *slot, unsigned int stamp, float value)
+{
+	if (!slot->count || slot->stamp != stamp)
+	{
+		slot->stamp	= stamp;
+		slot->count	= 0;
+		slot->sum	= 0.0;
+		slot->min	= slot->max = slot->p95 = value;
+	}
+
+	slot->count++;
+	slot->sum += value;
+
+	if (value < slot->min) slot->min = value;
+	if (value > slot->max) slot->max = value;
+}
+
+/* The 95th percentile of a minute, from the mean of each of its seconds */
+static float
+minute_p95 (const struct genmon_history *history, unsigned int minute)
+{
+	float value[60];
+	int i, n = 0;
+
+	for (i = 0; i < 60; i++)
+		if (history->second[i].count && history->second[i].stamp / 60 == minute)
+			value[n++] = history->second[i].sum / history->second[i].count;
+
+	return percentile95 (value, n);
+}
+
+/* An estimate of the 95th percentile of an hour, from those of its minutes */
+static float
+hour_p95 (const struct genmon_history *history, unsigned int hour, unsigned int now)
+{
+	float value[60];
+	int i, n = 0;
+
+	for (i = 0; i < 60; i++)
+		if (history->minute[i].count && history->minute[i].stamp / 60 == hour)
+			value[n++] = (history->minute[i].stamp == now / 60)
+				? minute_p95 (history, now / 60) : history->minute[i].p95;
+
+	return percentile95 (value, n);
+}
+
+/* Add a sample taken at now seconds. The percentiles of a minute, or an hour,
+ * are worked out once as it ends, so each sample costs the same.
+ */
+void
+genmon_history_update (struct genmon_history *history, unsigned int now, float value)
+{
+	unsigned int last = history->last;
+	struct genmon_history_slot *slot;
+
+	if (last && now / 60 != last / 60)
+	{
+		slot = history->minute + (last / 60) % 60;
+		if (slot->stamp == last / 60) slot->p95 = minute_p95 (history, last / 60);
+	}
+
+	if (last && now / 3600 != last / 3600)
+	{
+		slot = history->hour + (last / 3600) % 24;
+		if (slot->stamp == last / 3600) slot->p95 = hour_p95 (history, last / 3600, last);
+	}
+
+	slot_add (history->second + now % 60, now, value);
+	slot_add (history->minute + (now / 60) % 60, now / 60, value);
+	slot_add (history->hour + (now / 3600) % 24, now / 3600, value);
+
+	history->last = now;
+}
+
+/* Minimum, average and maximum over the slots stamped within a ring's length
+ * of stamp.
+ */
+static void
+summarize (struct genmon_summary *summary, const struct genmon_history_slot *slot, int slots, unsigned int stamp)
+{
+	double sum = 0.0;
+	int i;
+
+	memset (summary, 0, sizeof (*summary));
+
+	for (i = 0; i < slots; i++, slot++)
+	{
+		if (!slot->count || slot->stamp > stamp || slot->stamp + slots <= stamp) continue;
+
+		if (!summary->count || slot->min < summary->min) summary->min = slot->min;
+		if (!summary->count || slot->max > summary->max) summary->max = slot->max;
+
+		summary->count += slot->count;
+		sum += slot->sum;
+	}
+
+	if (summary->count) summary->avg = sum / summary->count;
+}
+
+/* Summarize the last minute, hour and day, as seen at now seconds, in to an
+ * array of GENMON_WINDOWS summaries.
+ */
+void
+genmon_history_summarize (const struct genmon_history *history, unsigned int now, struct genmon_summary *summary)
+{
+	float value[60];
+	int i, n;
+
+	summarize (summary + GENMON_MINUTE, history->second, 60, now);
+	summarize (summary + GENMON_HOUR, history->minute, 60, now / 60);
+	summarize (summary + GENMON_DAY, history->hour, 24, now / 3600);
+
+	/* The percentile of the last minute is exact, the others estimates */
+	for (i = n = 0; i < 60; i++)
+		if (history->second[i].count && history->second[i].stamp <= now && history->second[i].stamp + 60 > now)
+			value[n++] = history->second[i].sum / history->second[i].count;
+
+	summary[GENMON_MINUTE].p95 = percentile95 (value, n);
+
+	for (i = n = 0; i < 60; i++)
+	{
+		const struct genmon_history_slot *slot = history->minute + i;
+
+		if (slot->count && slot->stamp <= now / 60 && slot->stamp + 60 > now / 60)
+			value[n++] = (slot->stamp == now / 60) ? minute_p95 (history, slot->stamp) : slot->p95;
+	}
+
+	summary[GENMON_HOUR].p95 = percentile95 (value, n);
+
+	for (i = n = 0; i < 24; i++)
+	{
+		const struct genmon_history_slot *slot = history->hour + i;
+
+		if (slot->count && slot->stamp <= now / 3600 && slot->stamp + 24 > now / 3600)
+			value[n++] = (slot->stamp == now / 3600) ? hour_p95 (history, slot->stamp, now) : slot->p95;
+	}
+
+	summary[GENMON_DAY].p95 = percentile95 (value, n);
+}
+
+static int
+history_open (const char *name, int create, struct genmon_state **state, struct genmon_history *history)
+{
+	char path[128];
+
+	snprintf (path, 128, "history.%s", name);
+
+	if (!(*state = genmon_state_open (path, sizeof (*history), create))) return 0;
+
+	if (!genmon_state_read (*state, GENMON_HISTORY, history, sizeof (*history)))
+	{
+		if (!create)
+		{
+			genmon_state_close (*state, sizeof (*history));
+			return 0;
+		}
+
+		memset (history, 0, sizeof (*history));
+	}
+
+	return 1;
+}
+
+/* The time of a history, see struct genmon_history */
+static unsigned int
+history_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_BOOTTIME, &ts);
+	return ts.tv_sec;
+}
+
+/* Add a sample of a metric to its history file, and if summary is given fill
+ * it in as genmon_history_summarize does. Returns 0 on failure.
+ */
+int
+genmon_history_add (const char *name, float value, struct genmon_summary *summary)
+{
+	static struct genmon_history history;
+	struct genmon_state *state;
+	unsigned int now = history_now ();
+
+	if (!history_open (name, 1, &state, &history)) return 0;
+
+	genmon_history_update (&history, now, value);
+	genmon_state_write (state, GENMON_HISTORY, &history, sizeof (history));
+	genmon_state_close (state, sizeof (history));
+
+	if (summary) genmon_history_summarize (&history, now, summary);
+
+	return 1;
+}
+
+/* Summarize the history of a metric kept by another process, genmond. Returns
+ * 0 when there is none.
+ */
+int
+genmon_history_read (const char *name, struct genmon_summary *summary)
+{
+	static struct genmon_history history;
+	struct genmon_state *state;
+
+	if (!history_open (name, 0, &state, &history)) return 0;
+
+	genmon_state_close (state, sizeof (history));
+	genmon_history_summarize (&history, history_now (), summary);
+
+	return 1;
+}
+
+/* Add a tool tip line to the output for each window of a summary that has samples. Each
+ * value is shown as value * scale + offset with the printf format fmt.
+ */
+void
+genmon_print_history (const char *label, const struct genmon_summary *summary, const char *fmt,
+	float scale, float offset)
+{
+	static char *windows[] = { "minute", "hour", "day" };
+	char min[32], avg[32], max[32], p95[32];
+	int w;
+
+	for (w = 0; w < GENMON_WINDOWS; w++)
+	{
+		if (!summary[w].count) continue;
+
+		snprintf (min, 32, fmt, summary[w].min * scale + offset);
+		snprintf (avg, 32, fmt, summary[w].avg * scale + offset);
+		snprintf (max, 32, fmt, summary[w].max * scale + offset);
+		snprintf (p95, 32, fmt, summary[w].p95 * scale + offset);
+
+		genmon_out ("\n%s, last %s: min %s avg %s max %s p95 %s", label, windows[w], min, avg, max, p95);
+	}
+}
+
+/* Copy the latest sample out of genmond. Returns 0 when there is no daemon
+ * running, or its last sample is stale, in which case the monitors fall back
+ * to sampling on their own.
+ */
+int
+genmond_attach (struct genmond_sample *sample)
+{
+	struct genmon_state *state;
+	int ret;
+
+	if (!(state = genmon_state_open ("genmond", sizeof (*sample), 0))) return 0;
+
+	ret = genmon_state_read (state, GENMON_SAMPLE, sample, sizeof (*sample));
+	genmon_state_close (state, sizeof (*sample));
+
+	if (!ret) return 0;
+
+	/* The daemon must still be alive and the sample no older than a few
+	 * of its intervals.
+	 */
+	if (kill (sample->pid, 0) < 0) return 0;
+
+	if (genmon_nanos () - sample->nanos > 3000000000ULL * sample->interval) return 0;
+
+	return 1;
+}
@@ -0,0 +1,389 @@
+/*
+ * genmon.h - Shared definitions for the XFCE genmon plugin monitors.
+ * Copyright (C) 2013 Digirium, see <https://github.com/Digirium/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef GENMON_H
+#define GENMON_H
+
+#include <sys/types.h>
+
+#define GENMON_MAXCPUS		1024
+#define GENMON_MAXNETS		16
+#define GENMON_MAXIFACES	256
+#define GENMON_MAXDISKS		16
+#define GENMON_DISKSTATS	11	/* the fields of /proc/diskstats used */
+#define GENMON_PROCBUF		(1 << 20)
+#define GENMON_OUTBUF		(256 << 10)	/* of the XML for the plugin */
+#define GENMON_ARENA		(16 << 10)	/* of the strings put in it */
+
+/* Rates are only worked out over intervals between these, in nanoseconds */
+#define GENMON_RATE_MINNANOS	1000000ULL
+#define GENMON_RATE_MAXNANOS	3600000000000ULL
+
+/* The fastest a counter kept in 32 bits is taken to wrap, per second. Those
+ * are kept by drivers for links of 10 Gbit/s at most, in bytes, and by 32 bit
+ * kernels for disks, in sectors, requests and milliseconds.
+ */
+#define GENMON_RATE_MAXWRAP	1250000000ULL
+#define GENMON_DISK_MAXWRAP	(GENMON_RATE_MAXWRAP / 512)
+
+/* State kept between runs, and the samples published by genmond, live in
+ * small files in /dev/shm that are mapped with mmap. Each one holds a header
+ * followed by a single fixed-size record of the kind named in the header.
+ *
+ * Records are updated under a sequence lock: a writer makes seq odd while it
+ * is copying a record in and even again when done, so a reader that sees the
+ * same even value before and after its copy has a consistent record. Only one
+ * writer at a time gets the lock, an overlapping run of the same monitor just
+ * skips its update. The pid of the writer is taken with the lock in the same
+ * word, so a lock left by one that died can be told from one still held.
+ */
+#define GENMON_STATE_MAGIC	0x54534d47	/* "GMST" */
+#define GENMON_STATE_VERSION	2
+
+enum GENMON_KIND { GENMON_SAMPLE = 1, GENMON_CPU, GENMON_NET, GENMON_DISK, GENMON_HISTORY, GENMON_PACMAN, GENMON_FFPC,
+	GENMON_COMMAND, GENMON_NETSET };
+
+struct genmon_state
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int kind;
+	unsigned int size;	/* bytes in the record following the header */
+	unsigned long long int seq;	/* the count, and above it the pid holding the lock while odd */
+};
+
+/* The hwmon sysfs files cpuinfo reads temperature and fan speed from. They
+ * are looked for once and then kept in its state. A path of "-" means none
+ * was found, and the sensors program is used instead.
+ */
+struct genmon_hwmon
+{
+	char temppath[128];
+	char fanpath[128];
+};
+
+/* cpuinfo, /dev/shm/genmon.cpuinfo.UID */
+struct genmon_cpu_state
+{
+	struct genmon_hwmon hwmon;
+	unsigned long long int total[GENMON_MAXCPUS];
+	unsigned long long int idle[GENMON_MAXCPUS];
+	float maxtemp;
+	int maxrpm;
+	int packages;			/* 0 until the topology has been read */
+	short package[GENMON_MAXCPUS];
+};
+
+/* netinfo, /dev/shm/genmon.netinfo.IFACE.UID */
+struct genmon_net_state
+{
+	unsigned long long int rx[8], tx[8];	/* the columns of /proc/net/dev */
+	unsigned long long int nanos;
+	int ifindex;				/* 0 until looked up over netlink */
+};
+
+/* Interfaces matched by patterns, as veth are, come and go by the hundred, so
+ * netinfo keeps all those matched in one state, of the ones there last run.
+ */
+struct genmon_netset_state
+{
+	int count;
+	char name[GENMON_MAXIFACES][32];
+	struct genmon_net_state net[GENMON_MAXIFACES];
+};
+
+/* Where the temperature of a disk comes from, looked for once and then kept.
+ * temppath is a drivetemp or nvme hwmon input, or "-" when there is none and
+ * SMART is read instead, no more often than a set number of seconds.
+ */
+struct genmon_disktemp
+{
+	char temppath[128];
+	char id[128];				/* model */
+	float temp;				/* of the last SMART read */
+	unsigned long long int nanos;
+};
+
+/* The load on a disk over an interval, worked out from /proc/diskstats */
+struct genmon_diskio
+{
+	float readrate, writerate;	/* bytes/second */
+	float iops;
+	float await;			/* milliseconds per request */
+	float util;			/* percent of the time busy */
+};
+
+/* diskinfo, /dev/shm/genmon.diskinfo.MAJ.MIN.UID */
+struct genmon_disk_state
+{
+	char mountpath[256];
+	char diskpath[256];
+	unsigned long long int mntid;			/* of the mount when looked up */
+	float maxdisktemp;
+	struct genmon_disktemp disktemp;
+	unsigned int major, minor;			/* of the whole disk, or 0 */
+	unsigned long long int stats[GENMON_DISKSTATS];
+	unsigned long long int nanos;
+};
+
+/* pacscan, /dev/shm/genmon.pacscan.UID. The counts are worked out again only
+ * when the modification time of a directory they come from has changed.
+ */
+struct genmon_pac_state
+{
+	unsigned long long int localmtime, syncmtime, cachemtime;	/* nanoseconds */
+	unsigned long long int conf;		/* of pacman.conf, the options and the sync path */
+	unsigned int installed, foreign, upgrades;
+	unsigned long long int cachebytes;
+	char upgradelist[4096];			/* names separated by spaces */
+};
+
+/* ffpcsyncd, /dev/shm/genmon.ffpcsyncd.DEV.INO.UID for the cache directory */
+struct genmon_ffpc_state
+{
+	pid_t pid;				/* of the daemon, 0 once it has stopped */
+	unsigned int syncs;			/* done since it started */
+	unsigned int dirty;			/* entries changed since the last one */
+	unsigned long long int bytes;		/* allocated to the cache */
+	long long int synced;			/* time of the last sync */
+};
+
+/* The output of a helper program, /dev/shm/genmon.helper.NAME.UID, given in
+ * place of a fresh one when a run of it is late. A late run carries on in the
+ * background and leaves its output here for the next.
+ */
+#define GENMON_HELPEROUT	4096
+
+struct genmon_helper_state
+{
+	unsigned long long int nanos;		/* when it was had, 0 if never */
+	pid_t pid;				/* of a run still going, or 0 */
+	unsigned long long int start;		/* and its start time, in clock ticks */
+	long maxrss;				/* peak RSS of the run, in KB */
+	int len;
+	char output[GENMON_HELPEROUT];
+};
+
+/* History of one metric, /dev/shm/genmon.history.NAME.UID. Samples are added
+ * to a slot for the second, the minute and the hour they fall in, each ring
+ * reaching back a minute, an hour and a day. A slot is reused once its stamp,
+ * the time divided by its resolution, is out of date. The time is seconds of
+ * CLOCK_BOOTTIME, which unlike the clock rates are worked out with goes on
+ * while the machine is suspended, so samples from before are aged out by the
+ * time it was away. About 4.6KB a metric.
+ */
+struct genmon_history_slot
+{
+	unsigned int stamp;
+	unsigned int count;
+	float min, max;
+	float p95;		/* of the finer slots, once the slot is over */
+	double sum;
+};
+
+struct genmon_history
+{
+	unsigned int last;	/* seconds since boot, of the latest sample */
+	struct genmon_history_slot second[60];
+	struct genmon_history_slot minute[60];
+	struct genmon_history_slot hour[24];
+};
+
+/* Summaries over the last minute, hour and day */
+enum GENMON_WINDOW { GENMON_MINUTE = 0, GENMON_HOUR, GENMON_DAY, GENMON_WINDOWS };
+
+struct genmon_summary
+{
+	unsigned int count;
+	float min, avg, max, p95;
+};
+
+/* The genmond daemon samples every monitor on one timer and publishes the
+ * results in /dev/shm/genmon.genmond.UID, which the monitors map read only.
+ */
+struct genmond_cpu
+{
+	int cpus;
+	float temp, maxtemp;
+	int rpm, maxrpm;
+	int stale;			/* temp and rpm are the last sensors gave */
+	int packages;
+	signed char percent[GENMON_MAXCPUS];	/* -1 when offline */
+	short package[GENMON_MAXCPUS];
+};
+
+struct genmond_mem
+{
+	/* Values in kB, as given by /proc/meminfo */
+	unsigned long long int total, free, buffers, cached;
+};
+
+struct genmond_net
+{
+	char interface[32];
+	int down;
+	unsigned long long int rx[8], tx[8];		/* the columns of /proc/net/dev */
+	unsigned long long int raterx[8], ratetx[8];	/* the same per second */
+};
+
+struct genmond_disk
+{
+	char mountpath[256];
+	char diskpath[256];
+	char id[128];
+	dev_t dev;
+	unsigned int major, minor;			/* of the whole disk, or 0 */
+	float disktemp, maxdisktemp;
+	int stale;			/* disktemp is the last the disk gave */
+	unsigned long long int stats[GENMON_DISKSTATS];
+	struct genmon_diskio io;
+};
+
+struct genmond_sample
+{
+	pid_t pid;
+	int interval;			/* seconds between samples */
+	unsigned long long int nanos;	/* CLOCK_MONOTONIC_RAW of the sample */
+
+	struct genmond_cpu cpu;
+	struct genmond_mem mem;
+
+	int nets;
+	struct genmond_net net[GENMON_MAXNETS];
+
+	int disks;
+	struct genmond_disk disk[GENMON_MAXDISKS];
+};
+
+/* Files are looked for under GENMON_ROOT when it is set, a capture made by
+ * genmoncapture, instead of on the running system. genmon_path gives the path
+ * to use for an absolute one, good until a few more calls.
+ */
+extern const char *genmon_root (void);
+extern const char *genmon_path (const char *path);
+extern int genmon_cpus (void);
+
+/* Parsing of the pseudo-files, shared by the monitors and genmond */
+extern unsigned long long int genmon_nanos (void);
+extern int genmon_read_file (const char *path, char *buffer, int size);
+extern const char *genmon_read_proc (const char *path);
+extern unsigned long long int genmon_scan (const char **pp);
+extern int genmon_parse_stat (const char *p, int cpus, unsigned long long int *total, unsigned long long int *idle);
+extern int genmon_parse_meminfo (const char *p, struct genmond_mem *mem);
+extern const char *genmon_parse_netdev (const char *p, char *name, int size,
+	unsigned long long int *rx, unsigned long long int *tx);
+extern int genmon_parse_diskstats (const char *p, unsigned int major, unsigned int minor,
+	unsigned long long int *stats, int n);
+
+/* Sampling, shared by the monitors and genmond */
+extern int genmon_read_stat (int cpus, unsigned long long int *total, unsigned long long int *idle);
+extern unsigned long long int genmon_rate (unsigned long long int count, unsigned long long int prevcount,
+	unsigned long long int nanos);
+extern void genmon_cpu_usage (int cpus, const unsigned long long int *total, const unsigned long long int *idle,
+	const unsigned long long int *prevtotal, const unsigned long long int *previdle, signed char *percent);
+extern int genmon_cpu_packages (int cpus, short *package);
+extern int genmon_hwmon_discover (struct genmon_hwmon *hwmon);
+extern int genmon_hwmon_read (const char *path, int *fd, long *value);
+extern int genmon_read_sensors (int cpus, struct genmon_hwmon *hwmon, int *fds, float *temp, int *rpm);
+extern int genmon_read_meminfo (struct genmond_mem *mem);
+extern int genmon_read_netdev (const char *interface, unsigned long long int *rx, unsigned long long int *tx);
+extern int genmon_netlink_open (void);
+extern int genmon_netlink_link (int fd, const char *name, int *ifindex,
+	unsigned long long int *rx, unsigned long long int *tx);
+extern int genmon_mount_device (dev_t dev, char *diskpath, int size);
+extern int genmon_read_hddtemp (const char *diskpath, char *id, int size, float *temp);
+
+/* Helper programs are waited for at most genmon_helper_wait ms, after which
+ * the last output they gave is used, see genmon_helper.
+ */
+#define GENMON_FRESH		1
+#define GENMON_STALE		2
+
+extern int genmon_helper_wait;
+extern long genmon_helper_maxrss;
+extern int genmon_helper (const char *name, const char *command, char *output, int size);
+extern int genmon_block_disk (const char *diskpath, char *disk, int size);
+extern int genmon_block_devnum (const char *disk, unsigned int *major, unsigned int *minor);
+extern int genmon_read_diskstats (unsigned int major, unsigned int minor, unsigned long long int *stats);
+extern void genmon_disk_io (const unsigned long long int *stats, const unsigned long long int *prevstats,
+	unsigned long long int nanos, struct genmon_diskio *io);
+extern int genmon_read_disktemp (const char *diskpath, struct genmon_disktemp *disktemp, int ttl, float *temp);
+
+/* State files */
+extern char *genmon_state_path (const char *name, char *path, int size);
+extern struct genmon_state *genmon_state_open (const char *name, unsigned int size, int create);
+extern int genmon_state_read (struct genmon_state *state, unsigned int kind, void *record, unsigned int size);
+extern int genmon_state_write (struct genmon_state *state, unsigned int kind, const void *record, unsigned int size);
+extern void genmon_state_close (struct genmon_state *state, unsigned int size);
+
+/* Metric history */
+extern void genmon_history_update (struct genmon_history *history, unsigned int now, float value);
+extern void genmon_history_summarize (const struct genmon_history *history, unsigned int now,
+	struct genmon_summary *summary);
+extern int genmon_history_add (const char *name, float value, struct genmon_summary *summary);
+extern int genmon_history_read (const char *name, struct genmon_summary *summary);
+extern void genmon_print_history (const char *label, const struct genmon_summary *summary, const char *fmt,
+	float scale, float offset);
+
+/* genmond samples */
+extern int genmond_attach (struct genmond_sample *sample);
+
+/* Output for the plugin, built up in a fixed buffer and written with a single
+ * write. Strings from genmon_format, genmon_escape and genmon_span last until
+ * then. Text in <txt> and <tool> is markup, so anything that did not come from
+ * the monitor itself, as a path or a name, goes through genmon_escape.
+ */
+extern void genmon_out (const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+extern char *genmon_format (const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+extern const char *genmon_escape (const char *text);
+extern const char *genmon_span (const char *color, const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
+extern void genmon_out_img (void);
+extern void genmon_out_bar (int percent);
+extern int genmon_out_flush (void);
+
+/* Options and help common to the monitors */
+#define GENMON_HELP_DEBUG	"-d --debug\t\tDisplay debugging output.\n"
+#define GENMON_HELP_HELP	"-h --help\t\tDisplay this help.\n"
+#define GENMON_HELP_ICON	"-i[FILE] --icon[=FILE]\tSet the icon filename, or disable the icon.\n"
+#define GENMON_HELP_VERSION	"-v --version\t\tDisplay version information.\n"
+#define GENMON_HELP_LONG	"\nLong options may be passed with a single dash.\n\n"
+
+#define GENMON_HELP_STATS	"-s --stats\t\tReport timings and resource use on stderr as key=value.\n"
+#define GENMON_HELP_WAIT	"-wMS --wait=MS\t\tWait at most MS for each run of sensors or hddtemp (default 250).\n"
+
+extern char genmon_iconfile[256];
+extern int genmon_showicon;
+extern void genmon_icon_init (const char *prog);
+extern void genmon_icon_option (const char *arg);
+extern void genmon_show_version (const char *prog, const char *vers);
+
+/* Where the time of a run goes. The monitors switch between options, parse and
+ * output, the library switches to the others around its own calls and back.
+ * With -d or -s the times are reported on stderr at exit, along with the bytes
+ * and the read and write calls from /proc/self/io and the peak RSS.
+ */
+enum GENMON_PHASE { GENMON_OPTIONS = 0, GENMON_PARSE, GENMON_CACHE_READ, GENMON_HELPER, GENMON_CACHE_WRITE,
+	GENMON_OUTPUT, GENMON_PHASES };
+
+#define GENMON_DEBUG	1	/* -d, for people */
+#define GENMON_STATS	2	/* -s, for scripts */
+
+extern int genmon_debug;
+extern int genmon_phase (int phase);
+extern void genmon_debug_option (const char *prog, int flag);
+
+#endif /* GENMON_H */
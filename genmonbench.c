@@ -0,0 +1,344 @@
+/*
+ * genmonbench.c - Parser benchmark for the XFCE genmon plugin monitors.
+ * Copyright (C) 2013 Digirium, see <https://github.com/Digirium/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+static char *prog = "genmonbench";
+static char *vers = "1.0.0";
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "genmon.h"
+
+/* Option parsing */
+static int iterations = 100000;
+static char *statfile = "/proc/stat";
+static char *meminfofile = "/proc/meminfo";
+static char *netdevfile = "/proc/net/dev";
+static char *diskstatsfile = "/proc/diskstats";
+static int runs = 200;
+static char *replaydir = NULL;
+static char **command = NULL;
+
+#define MAXRUNS		10000
+
+extern char **environ;
+
+/* Allocations are counted by linking with --wrap for each allocator */
+static unsigned long long int allocs = 0;
+
+extern void *__real_malloc (size_t size);
+extern void *__real_calloc (size_t nmemb, size_t size);
+extern void *__real_realloc (void *ptr, size_t size);
+
+void *__wrap_malloc (size_t size)		{ allocs++; return __real_malloc (size); }
+void *__wrap_calloc (size_t nmemb, size_t size)	{ allocs++; return __real_calloc (nmemb, size); }
+void *__wrap_realloc (void *ptr, size_t size)	{ allocs++; return __real_realloc (ptr, size); }
+
+static char buffer[GENMON_PROCBUF + 16];
+static unsigned long long int total[GENMON_MAXCPUS], idle[GENMON_MAXCPUS];
+
+static void
+show_version (void)
+{
+	printf ("%s %s - (C) 2013 Digirium, see <https://github.com/Digirium>\n", prog, vers);
+	printf ("Released under the GNU GPL.\n\n");
+}
+
+static void
+show_usage (void)
+{
+	printf ("Usage: %s [options]\n", prog);
+	printf ("       %s [-rN] [-RDIR] <program> [arguments]\n", prog);
+}
+
+static void
+show_help (void)
+{
+	show_version ();
+	show_usage ();
+	printf ("\n");
+
+	printf ("-DFILE --diskstats=FILE	Parse FILE as /proc/diskstats.\n");
+	printf ("-h --help		Display this help.\n");
+	printf ("-MFILE --meminfo=FILE	Parse FILE as /proc/meminfo.\n");
+	printf ("-nN --iterations=N	Parse each file N times (default 100000).\n");
+	printf ("-NFILE --netdev=FILE	Parse FILE as /proc/net/dev.\n");
+	printf ("-rN --runs=N		Run a program N times (default 200).\n");
+	printf ("-RDIR --replay=DIR	Run it over the snapshots taken by genmoncapture in DIR.\n");
+	printf ("-SFILE --stat=FILE	Parse FILE as /proc/stat.\n");
+	printf ("-v --version		Display version information.\n");
+
+	printf ("\nGiven a program, times it from exec to exit instead, with its output\n");
+	printf ("thrown away, as the plugin would run a monitor. With a replay, each run\n");
+	printf ("has GENMON_ROOT set to the next snapshot, in turn.\n");
+	printf ("\nLong options may be passed with a single dash.\n\n");
+}
+
+static void
+get_options (int argc, char *argv[])
+{
+	static struct option long_opts[] =
+	{
+		{ "diskstats",	required_argument,	0, 'D' },
+		{ "help",	no_argument,		0, 'h' },
+		{ "iterations",	required_argument,	0, 'n' },
+		{ "meminfo",	required_argument,	0, 'M' },
+		{ "netdev",	required_argument,	0, 'N' },
+		{ "replay",	required_argument,	0, 'R' },
+		{ "runs",	required_argument,	0, 'r' },
+		{ "stat",	required_argument,	0, 'S' },
+		{ "version",	no_argument,		0, 'v' },
+		{ 0,0,0,0 }
+	};
+
+	int opt, opti;
+
+	while ((opt = getopt_long (argc, argv, "+D:hM:n:N:r:R:S:v", long_opts, &opti)))
+	{
+		if (opt == EOF) break;
+
+		switch (opt)
+		{
+		case 'D':	diskstatsfile = optarg;			break;
+		case 'M':	meminfofile = optarg;			break;
+		case 'n':	iterations = atoi (optarg);		break;
+		case 'N':	netdevfile = optarg;			break;
+		case 'r':	runs = atoi (optarg);			break;
+		case 'R':	replaydir = optarg;			break;
+		case 'S':	statfile = optarg;			break;
+
+		case 'h':
+			show_help ();
+			exit (0);
+
+		case 'v':
+			show_version ();
+			exit (0);
+
+		default:
+			exit (1);
+		}
+	}
+
+	if (iterations < 1) iterations = 1;
+	if (runs < 1) runs = 1;
+	if (runs > MAXRUNS) runs = MAXRUNS;
+
+	if (optind < argc) command = argv + optind;
+}
+
+/* A /proc/stat as seen on a 256 CPU machine, for when there is none to hand */
+static void
+make_stat256 (void)
+{
+	char *p = buffer;
+	int n;
+
+	p += sprintf (p, "cpu  1234567890 1234 987654321 12345678901 123456 0 765432 0 0 0\n");
+
+	for (n = 0; n < 256; n++)
+		p += sprintf (p, "cpu%d %d 12 %d %d 4321 0 %d 0 0 0\n",
+			n, 4822000 + n * 37, 3858000 + n * 11, 48220000 + n * 53, 2990 + n);
+
+	p += sprintf (p, "intr 912345678 44 0 0 0 0 0 0 0 1 0 0 0 0 0 0 0 0 0\n");
+	p += sprintf (p, "ctxt 1987654321\nbtime 1381234567\nprocesses 2345678\n");
+
+	memset (p, 0, 9);
+}
+
+static int
+load (char *path)
+{
+	if (genmon_read_file (path, buffer, sizeof (buffer)) >= 0) return 1;
+
+	printf ("%-12s cannot read %s\n", "", path);
+	return 0;
+}
+
+static void
+report (char *name, int count, unsigned long long int start, unsigned long long int startallocs, int result)
+{
+	unsigned long long int nanos = genmon_nanos () - start;
+
+	printf ("%-12s %10.1f ns/parse %8.3f allocs/run   (%d)\n", name,
+		(double)nanos / count, (double)(allocs - startallocs) / count, result);
+}
+
+static int
+compare (const void *a, const void *b)
+{
+	unsigned long long int x = *(const unsigned long long int *)a, y = *(const unsigned long long int *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* The snapshots of a capture are named by number */
+static int
+is_snapshot (const struct dirent *entry)
+{
+	return strspn (entry->d_name, "0123456789") == strlen (entry->d_name);
+}
+
+/* Time a program from exec to exit, each run in microseconds */
+static int
+time_command (void)
+{
+	static unsigned long long int nanos[MAXRUNS];
+	posix_spawn_file_actions_t actions;
+	unsigned long long int start, sum = 0;
+	struct dirent **snapshot = NULL;
+	char root[PATH_MAX];
+	pid_t pid;
+	int i, status, snapshots = 0;
+
+	if (replaydir && (snapshots = scandir (replaydir, &snapshot, is_snapshot, alphasort)) <= 0)
+	{
+		fprintf (stderr, "%s: no snapshots in %s\n", prog, replaydir);
+		return 1;
+	}
+
+	/* The state the monitors left in the capture by an earlier replay is
+	 * cleared, so each replay starts the same.
+	 */
+	if (replaydir)
+	{
+		struct dirent *entry;
+		DIR *d;
+
+		snprintf (root, sizeof (root), "%s/shm", replaydir);
+
+		if ((d = opendir (root)))
+		{
+			while ((entry = readdir (d)))
+				if (strncmp (entry->d_name, "genmon.", 7) == 0) unlinkat (dirfd (d), entry->d_name, 0);
+			closedir (d);
+		}
+	}
+
+	posix_spawn_file_actions_init (&actions);
+	posix_spawn_file_actions_addopen (&actions, 1, "/dev/null", O_WRONLY, 0);
+	posix_spawn_file_actions_adddup2 (&actions, 1, 2);
+
+	for (i = 0; i < runs; i++)
+	{
+		if (snapshots)
+		{
+			snprintf (root, sizeof (root), "%s/%s", replaydir, snapshot[i % snapshots]->d_name);
+			setenv ("GENMON_ROOT", root, 1);
+		}
+
+		start = genmon_nanos ();
+
+		if ((errno = posix_spawnp (&pid, command[0], &actions, NULL, command, environ)))
+		{
+			perror (command[0]);
+			return 1;
+		}
+
+		waitpid (pid, &status, 0);
+		sum += nanos[i] = genmon_nanos () - start;
+	}
+
+	qsort (nanos, runs, sizeof (nanos[0]), compare);
+
+	printf ("%-12s %8.1f us min %8.1f us median %8.1f us p95 %8.1f us p99 %8.1f us mean   (%d)\n", command[0],
+		nanos[0] / 1000.0, nanos[runs / 2] / 1000.0, nanos[runs * 95 / 100] / 1000.0, nanos[runs * 99 / 100] / 1000.0,
+		sum / 1000.0 / runs, WIFEXITED (status) ? WEXITSTATUS (status) : -1);
+
+	if (snapshots) printf ("%-12s over %d snapshots of %s\n", "", snapshots, replaydir);
+
+	return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+	get_options (argc, argv);
+
+	if (command) return time_command ();
+
+	unsigned long long int start, startallocs, rx[8], tx[8], stats[11];
+	struct genmond_mem mem;
+	const char *p;
+	char name[32];
+	int n, i, result = 0;
+
+	/* Each file is read once and then parsed from memory, so the figures are
+	 * for the parsing alone. The last figure is what the parser returned.
+	 */
+	if (load (statfile))
+	{
+		start = genmon_nanos (), startallocs = allocs;
+		for (i = 0; i < iterations; i++) result = genmon_parse_stat (buffer, GENMON_MAXCPUS, total, idle);
+		report ("stat", iterations, start, startallocs, result);
+	}
+
+	make_stat256 ();
+	start = genmon_nanos (), startallocs = allocs;
+	for (i = 0; i < iterations; i++) result = genmon_parse_stat (buffer, GENMON_MAXCPUS, total, idle);
+	report ("stat256", iterations, start, startallocs, result);
+
+	if (load (meminfofile))
+	{
+		start = genmon_nanos (), startallocs = allocs;
+		for (i = 0; i < iterations; i++) result = genmon_parse_meminfo (buffer, &mem);
+		report ("meminfo", iterations, start, startallocs, result);
+	}
+
+	if (load (netdevfile))
+	{
+		start = genmon_nanos (), startallocs = allocs;
+		for (i = 0; i < iterations; i++)
+			for (p = buffer, result = 0; (p = genmon_parse_netdev (p, name, 32, rx, tx)); )
+				if (name[0]) result++;
+		report ("netdev", iterations, start, startallocs, result);
+	}
+
+	if (load (diskstatsfile))
+	{
+		/* Look for the device on the last line, the worst case */
+		unsigned int major = 0, minor = 0;
+
+		for (p = buffer; p && *p; p = strchr (p, '\n'), p = p ? p + 1 : NULL)
+		{
+			const char *q = p;
+			major = genmon_scan (&q);
+			minor = genmon_scan (&q);
+		}
+
+		start = genmon_nanos (), startallocs = allocs;
+		for (i = 0; i < iterations; i++) result = genmon_parse_diskstats (buffer, major, minor, stats, 11);
+		report ("diskstats", iterations, start, startallocs, result);
+	}
+
+	/* Reading as well as parsing, as the monitors do */
+	n = iterations / 100 + 1;
+	start = genmon_nanos (), startallocs = allocs;
+	for (i = 0; i < n; i++) result = genmon_read_stat (GENMON_MAXCPUS, total, idle);
+	report ("read+stat", n, start, startallocs, result);
+
+	return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * genmonbox.c - Multi-call binary for the XFCE genmon plugin monitors.
+ * Copyright (C) 2013 Digirium, see <https://github.com/Digirium/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+static char *prog = "genmonbox";
+static char *vers = "1.0.0";
+
+#include <stdio.h>
+#include <string.h>
+
+#include "genmon.h"
+
+/* The monitors, each built with its main renamed, see the box target in the
+ * Makefile.
+ */
+extern int cpuinfo_main (int argc, char *argv[]);
+extern int diskinfo_main (int argc, char *argv[]);
+extern int meminfo_main (int argc, char *argv[]);
+extern int netinfo_main (int argc, char *argv[]);
+
+static struct { const char *name; int (*main) (int argc, char *argv[]); } applets[] =
+{
+	{ "cpuinfo",	cpuinfo_main },
+	{ "diskinfo",	diskinfo_main },
+	{ "meminfo",	meminfo_main },
+	{ "netinfo",	netinfo_main },
+	{ 0,0 }
+};
+
+static void
+show_help (void)
+{
+	int i;
+
+	genmon_show_version (prog, vers);
+
+	printf ("Usage: %s <monitor> [options]\n", prog);
+	printf ("       <monitor> [options], run through a link named after it\n");
+	printf ("\nMonitors:");
+	for (i = 0; applets[i].name; i++) printf (" %s", applets[i].name);
+	printf ("\n\n");
+}
+
+static int
+find_applet (const char *name)
+{
+	const char *slash = strrchr (name, '/');
+	int i;
+
+	if (slash) name = slash + 1;
+
+	for (i = 0; applets[i].name; i++)
+		if (strcmp (name, applets[i].name) == 0) return i;
+
+	return -1;
+}
+
+int
+main (int argc, char *argv[])
+{
+	int i;
+
+	/* Run as a link named after a monitor, as the plugin does */
+	if ((i = find_applet (argv[0])) >= 0) return applets[i].main (argc, argv);
+
+	/* Or as genmonbox, with the monitor named first */
+	if (argc > 1 && (i = find_applet (argv[1])) >= 0) return applets[i].main (argc - 1, argv + 1);
+
+	if (argc > 1 && (strcmp (argv[1], "-v") == 0 || strcmp (argv[1], "--version") == 0))
+	{
+		genmon_show_version (prog, vers);
+		return 0;
+	}
+
+	show_help ();
+	return (argc > 1 && (strcmp (argv[1], "-h") == 0 || strcmp (argv[1], "--help") == 0)) ? 0 : 2;
+}
@@ -0,0 +1,434 @@
+/*
+ * genmond.c - Sampler daemon for the XFCE genmon plugin monitors.
+ * Copyright (C) 2013 Digirium, see <https://github.com/Digirium/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+static char *prog = "genmond";
+static char *vers = "1.0.0";
+
+#define _GNU_SOURCE	/* ppoll */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "genmon.h"
+
+/* Option parsing */
+static int debug = 0;
+static int diskinterval = 30;
+static int interval = 2;
+
+/* The sample is built up in a local copy and then published to the state
+ * file under its sequence lock.
+ */
+static struct genmond_sample sample;
+static struct genmon_hwmon hwmon;
+static int hwmonfds[2] = { -1, -1 };
+static char *hddtemppath[GENMON_MAXDISKS];
+static struct genmon_disktemp disktemp[GENMON_MAXDISKS];
+static volatile sig_atomic_t quit = 0;
+
+static void
+show_version (void)
+{
+	printf ("%s %s - (C) 2013 Digirium, see <https://github.com/Digirium>\n", prog, vers);
+	printf ("Released under the GNU GPL.\n\n");
+}
+
+static void
+show_usage (void)
+{
+	printf ("Usage: %s [options] [-n <networkinterface>]... [-m <mountpath> [-t <disk>]]...\n", prog);
+}
+
+static void
+show_help (void)
+{
+	show_version ();
+	show_usage ();
+
+	printf ("\n-d --debug		Display debugging output.\n");
+	printf ("-h --help		Display this help.\n");
+	printf ("-iSECS --interval=SECS	Set the sampling interval (default 2).\n");
+	printf ("-mPATH --mount=PATH	Sample the disk mounted at a path.\n");
+	printf ("-nNAME --net=NAME	Sample a network interface.\n");
+	printf ("-TSECS --diskinterval=SECS	Set the SMART disk temperature interval (default 30).\n");
+	printf ("-tDISK --disktemp=DISK	Set the disk path to read temperature from for the last mount.\n");
+	printf ("-v --version		Display version information.\n");
+
+	printf ("\nLong options may be passed with a single dash.\n\n");
+}
+
+static void
+get_options (int argc, char *argv[])
+{
+	static struct option long_opts[] =
+	{
+		{ "debug",		no_argument,		0, 'd' },
+		{ "diskinterval",	required_argument,	0, 'T' },
+		{ "disktemp",		required_argument,	0, 't' },
+		{ "help",		no_argument,		0, 'h' },
+		{ "interval",		required_argument,	0, 'i' },
+		{ "mount",		required_argument,	0, 'm' },
+		{ "net",		required_argument,	0, 'n' },
+		{ "version",		no_argument,		0, 'v' },
+		{ 0,0,0,0 }
+	};
+
+	struct stat mountstat;
+	int opt, opti;
+
+	while ((opt = getopt_long (argc, argv, "dhi:m:n:T:t:v", long_opts, &opti)))
+	{
+		if (opt == EOF) break;
+
+		switch (opt)
+		{
+		case 'd':
+			debug = 1;
+			break;
+
+		case 'h':
+			show_help ();
+			exit (0);
+
+		case 'i':
+			if ((interval = atoi (optarg)) < 1) interval = 1;
+			break;
+
+		case 'm':
+			if (sample.disks == GENMON_MAXDISKS) break;
+
+			if (stat (optarg, &mountstat) < 0)
+			{
+				fprintf (stderr, "%s: cannot stat %s\n", prog, optarg);
+				exit (2);
+			}
+
+			snprintf (sample.disk[sample.disks].mountpath, 256, "%s", optarg);
+			sample.disk[sample.disks++].dev = mountstat.st_dev;
+			break;
+
+		case 'n':
+			if (sample.nets == GENMON_MAXNETS) break;
+
+			snprintf (sample.net[sample.nets++].interface, 32, "%s", optarg);
+			break;
+
+		case 'T':
+			if ((diskinterval = atoi (optarg)) < 1) diskinterval = 1;
+			break;
+
+		case 't':
+			if (sample.disks) hddtemppath[sample.disks - 1] = optarg;
+			break;
+
+		case 'v':
+			show_version ();
+			exit (0);
+
+		default:
+			exit (1);
+		}
+	}
+}
+
+/* Work out the rates of an interface from its new counters */
+static void
+net_update (struct genmond_net *net, const unsigned long long int *rx, const unsigned long long int *tx,
+	unsigned long long int prevnanos)
+{
+	int n;
+
+	/* An interface that was down has no previous counters */
+	if (prevnanos && !net->down)
+		for (n = 0; n < 8; n++)
+		{
+			net->raterx[n] = genmon_rate (rx[n], net->rx[n], sample.nanos - prevnanos);
+			net->ratetx[n] = genmon_rate (tx[n], net->tx[n], sample.nanos - prevnanos);
+		}
+
+	memcpy (net->rx, rx, sizeof (net->rx));
+	memcpy (net->tx, tx, sizeof (net->tx));
+}
+
+/* The mount table changed, a mount may now be a different filesystem. Look up
+ * each of the disks again, starting afresh. Only the mounts genmond was asked
+ * to watch are stat()ed.
+ */
+static void
+remount (void)
+{
+	struct stat mountstat;
+	int i;
+
+	for (i = 0; i < sample.disks; i++)
+	{
+		struct genmond_disk *disk = sample.disk + i;
+
+		if (stat (disk->mountpath, &mountstat) == 0) disk->dev = mountstat.st_dev;
+
+		disk->diskpath[0] = disk->id[0] = '\0';
+		disk->major = disk->minor = 0;
+		disk->disktemp = disk->maxdisktemp = 0.0;
+		memset (&disk->io, 0, sizeof (disk->io));
+		memset (disktemp + i, 0, sizeof (disktemp[i]));
+	}
+}
+
+/* Sleep until the next tick. Changes to the mount table are signalled on
+ * /proc/self/mountinfo with POLLPRI, which wakes it early to call remount.
+ */
+static void
+wait_tick (struct timespec *next, struct pollfd *mountinfo)
+{
+	struct timespec now, left;
+
+	while (!quit)
+	{
+		clock_gettime (CLOCK_MONOTONIC, &now);
+
+		left.tv_sec	= next->tv_sec - now.tv_sec;
+		left.tv_nsec	= next->tv_nsec - now.tv_nsec;
+
+		if (left.tv_nsec < 0) left.tv_sec--, left.tv_nsec += 1000000000L;
+		if (left.tv_sec < 0) break;
+
+		if (ppoll (mountinfo, mountinfo->fd >= 0, &left, NULL) > 0 && (mountinfo->revents & (POLLPRI | POLLERR)))
+		{
+			if (debug) fprintf (stderr, "%s: mount table changed\n", prog);
+			remount ();
+		}
+	}
+}
+
+static void
+on_signal (int sig __attribute__ ((unused)))
+{
+	quit = 1;
+}
+
+int
+main (int argc, char *argv[])
+{
+	get_options (argc, argv);
+
+	/* Create the state file. It is only writable by the owner, the monitors
+	 * run as the same user and map it read only.
+	 */
+	struct genmon_state *state = genmon_state_open ("genmond", sizeof (sample), 1);
+	assert (state != NULL);
+
+	signal (SIGINT, on_signal);
+	signal (SIGTERM, on_signal);
+	signal (SIGHUP, on_signal);
+
+	sample.pid = getpid ();
+	sample.interval = interval;
+
+	int cpus = genmon_cpus ();
+	if (cpus > GENMON_MAXCPUS) cpus = GENMON_MAXCPUS;
+	sample.cpu.cpus = cpus;
+
+	sample.cpu.packages = genmon_cpu_packages (cpus, sample.cpu.package);
+
+	/* Previous values are kept in memory, there is no cache file to read */
+	static unsigned long long int total[GENMON_MAXCPUS], idle[GENMON_MAXCPUS];
+	static unsigned long long int prevtotal[GENMON_MAXCPUS], previdle[GENMON_MAXCPUS];
+	unsigned long long int rx[8], tx[8], stats[GENMON_DISKSTATS], prevnanos = 0;
+	char name[32];
+	int i, j, tick;
+
+	/* Interfaces are looked up over netlink by index while it works */
+	static int ifindex[GENMON_MAXNETS];
+	char found[GENMON_MAXNETS];
+	int nlfd = genmon_netlink_open ();
+
+	struct pollfd mountinfo = { open ("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC), POLLPRI, 0 };
+
+	struct timespec next;
+	clock_gettime (CLOCK_MONOTONIC, &next);
+
+	for (tick = 0; !quit; tick++)
+	{
+		sample.nanos = genmon_nanos ();
+
+		/* CPU usage, temperature and fan speed */
+		genmon_read_stat (cpus, total, idle);
+		genmon_cpu_usage (cpus, total, idle, prevtotal, previdle, sample.cpu.percent);
+
+		memcpy (prevtotal, total, sizeof (total));
+		memcpy (previdle, idle, sizeof (idle));
+
+		/* A lost hwmon file is looked for again with fresh descriptors */
+		if (!hwmon.temppath[0])
+		{
+			if (hwmonfds[0] >= 0) close (hwmonfds[0]);
+			if (hwmonfds[1] >= 0) close (hwmonfds[1]);
+			hwmonfds[0] = hwmonfds[1] = -1;
+		}
+
+		/* When sensors is late the values are those it gave last, which are
+		 * shown as stale and not taken in to the history again.
+		 */
+		sample.cpu.stale = (genmon_read_sensors (cpus, &hwmon, hwmonfds, &sample.cpu.temp, &sample.cpu.rpm)
+			== GENMON_STALE);
+
+		if (sample.cpu.temp > sample.cpu.maxtemp)	sample.cpu.maxtemp = sample.cpu.temp;
+		if (sample.cpu.rpm > sample.cpu.maxrpm)		sample.cpu.maxrpm = sample.cpu.rpm;
+
+		/* While genmond runs it keeps the history, the monitors only read it */
+		int online = 0, sum = 0;
+
+		for (i = 0; i < cpus; i++)
+			if (sample.cpu.percent[i] >= 0) online++, sum += sample.cpu.percent[i];
+
+		if (tick && online)		genmon_history_add ("cpu", (float)sum / online, NULL);
+		if (sample.cpu.temp > 0.0 && !sample.cpu.stale)	genmon_history_add ("cputemp", sample.cpu.temp, NULL);
+
+		/* Memory */
+		if (genmon_read_meminfo (&sample.mem) == 4 && sample.mem.total)
+			genmon_history_add ("mem", (sample.mem.total - sample.mem.free - sample.mem.buffers
+				- sample.mem.cached) * 100.0 / sample.mem.total, NULL);
+
+		/* Network rates, in bytes/second. The counters come over netlink by
+		 * interface index, or else from one pass over the pseudo-file.
+		 */
+		memset (found, 0, sizeof (found));
+
+		for (i = 0; nlfd >= 0 && i < sample.nets; i++)
+			switch (genmon_netlink_link (nlfd, sample.net[i].interface, ifindex + i, rx, tx))
+			{
+			case 1:		net_update (sample.net + i, rx, tx, prevnanos), found[i] = 1;	break;
+			case 0:		break;
+			default:	close (nlfd), nlfd = -1;
+			}
+
+		const char *p = (sample.nets && nlfd < 0) ? genmon_read_proc ("/proc/net/dev") : NULL;
+
+		while (p && (p = genmon_parse_netdev (p, name, 32, rx, tx)))
+			for (i = 0; name[0] && i < sample.nets; i++)
+				if (!found[i] && strcmp (sample.net[i].interface, name) == 0)
+					net_update (sample.net + i, rx, tx, prevnanos), found[i] = 1;
+
+		for (i = 0; i < sample.nets; i++)
+			if (!(sample.net[i].down = !found[i]) && tick)
+			{
+				snprintf (name, 32, "net.%.16s.rx", sample.net[i].interface);
+				genmon_history_add (name, sample.net[i].raterx[0], NULL);
+				snprintf (name, 32, "net.%.16s.tx", sample.net[i].interface);
+				genmon_history_add (name, sample.net[i].ratetx[0], NULL);
+			}
+			else if (sample.net[i].down)
+			{
+				struct genmond_net *net = sample.net + i;
+
+				memset (net->rx, 0, sizeof (net->rx));
+				memset (net->tx, 0, sizeof (net->tx));
+				memset (net->raterx, 0, sizeof (net->raterx));
+				memset (net->ratetx, 0, sizeof (net->ratetx));
+			}
+
+		/* Disk I/O, and temperatures, which come from hwmon inputs where there are
+		 * any, cheap to read each time, and otherwise from SMART every diskinterval.
+		 */
+		for (i = 0; i < sample.disks; i++)
+		{
+			struct genmond_disk *disk = sample.disk + i;
+
+			int fresh = 0;
+
+			if (!disk->diskpath[0] && genmon_mount_device (disk->dev, disk->diskpath, 256))
+			{
+				/* I/O is counted for the whole disk a partition is on */
+				if (!genmon_block_disk (disk->diskpath, name, 32)
+					|| !genmon_block_devnum (name, &disk->major, &disk->minor))
+					disk->major = disk->minor = 0;
+
+				fresh = 1;
+			}
+
+			if (!disk->diskpath[0]) continue;
+
+			/* Mounts of partitions on a disk already sampled share its figures */
+			for (j = 0; j < i; j++)
+				if (disk->major && sample.disk[j].major == disk->major && sample.disk[j].minor == disk->minor
+					&& !hddtemppath[i] && !hddtemppath[j])
+					break;
+
+			if (j < i)
+			{
+				memcpy (disk->stats, sample.disk[j].stats, sizeof (disk->stats));
+				disk->io = sample.disk[j].io;
+				disk->disktemp = sample.disk[j].disktemp;
+				disk->stale = sample.disk[j].stale;
+				snprintf (disk->id, 128, "%s", sample.disk[j].id);
+
+				if (disk->disktemp == 0.0) continue;
+			}
+			else
+			{
+				if (disk->major && genmon_read_diskstats (disk->major, disk->minor, stats))
+				{
+					if (prevnanos && !fresh) genmon_disk_io (stats, disk->stats, sample.nanos - prevnanos, &disk->io);
+					memcpy (disk->stats, stats, sizeof (stats));
+				}
+
+				int ret = genmon_read_disktemp (hddtemppath[i] ? hddtemppath[i] : disk->diskpath,
+					disktemp + i, diskinterval, &disk->disktemp);
+
+				snprintf (disk->id, 128, "%s", disktemp[i].id);
+				disk->stale = (ret == GENMON_STALE);
+
+				if (!ret) continue;
+			}
+
+			if (disk->disktemp > disk->maxdisktemp) disk->maxdisktemp = disk->disktemp;
+
+			if (disk->stale) continue;
+
+			snprintf (name, 32, "disktemp.%d.%d", major (disk->dev), minor (disk->dev));
+			genmon_history_add (name, disk->disktemp, NULL);
+		}
+
+		prevnanos = sample.nanos;
+
+		genmon_state_write (state, GENMON_SAMPLE, &sample, sizeof (sample));
+
+		if (debug)
+			fprintf (stderr, "%s: sample %d took %lluus\n", prog, tick,
+				(genmon_nanos () - sample.nanos) / 1000);
+
+		/* Sleep until the next absolute tick so the interval does not drift */
+		next.tv_sec += interval;
+		wait_tick (&next, &mountinfo);
+	}
+
+	char path[PATH_MAX];
+	unlink (genmon_state_path ("genmond", path, sizeof (path)));
+
+	return 0;
+}
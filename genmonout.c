@@ -0,0 +1,296 @@
+/*
+ * genmonout.c - Output and options shared by the XFCE genmon plugin monitors.
+ * Copyright (C) 2013 Digirium, see <https://github.com/Digirium/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "genmon.h"
+
+/* The XML for the plugin is built up here and written out in one go. What
+ * does not fit is dropped, the output is cut short rather than overrun.
+ */
+static char outbuf[GENMON_OUTBUF];
+static int outlen = 0;
+
+/* Short lived strings for the output, escaped text and spans, come from an
+ * arena that is emptied each time the output is written.
+ */
+static char arena[GENMON_ARENA];
+static int arenalen = 0;
+
+char genmon_iconfile[256];
+int genmon_showicon = 1;
+int genmon_debug = 0;
+
+/* The phase being timed, since when, and the time of each so far */
+static int phase = GENMON_OPTIONS;
+static unsigned long long int phasestart = 0, phasenanos[GENMON_PHASES], runstart = 0;
+static const char *debugprog = NULL;
+
+static void
+append (const char *fmt, va_list ap)
+{
+	int n = vsnprintf (outbuf + outlen, GENMON_OUTBUF - outlen, fmt, ap);
+
+	if (n > 0) outlen += (n < GENMON_OUTBUF - outlen) ? n : GENMON_OUTBUF - outlen - 1;
+}
+
+void
+genmon_out (const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start (ap, fmt);
+	append (fmt, ap);
+	va_end (ap);
+}
+
+/* A formatted string in the arena. Once the arena is full the strings are
+ * cut short, in the end to nothing.
+ */
+static char *
+vformat (const char *fmt, va_list ap)
+{
+	char *s = arena + arenalen;
+	int n, room = GENMON_ARENA - arenalen;
+
+	if (room <= 1) return "";
+
+	if ((n = vsnprintf (s, room, fmt, ap)) < 0) n = 0;
+	arenalen += ((n < room) ? n : room - 1) + 1;
+
+	return s;
+}
+
+char *
+genmon_format (const char *fmt, ...)
+{
+	va_list ap;
+	char *s;
+
+	va_start (ap, fmt);
+	s = vformat (fmt, ap);
+	va_end (ap);
+
+	return s;
+}
+
+/* Text made safe for the markup the plugin gives GTK for the text and the tool
+ * tip, as a mount path or an interface name may hold any character.
+ */
+const char *
+genmon_escape (const char *text)
+{
+	char *s = arena + arenalen, *p = s, *end = arena + GENMON_ARENA - 1;
+	const char *entity;
+
+	if (!strpbrk (text, "&<>\"'")) return text;
+	if (s >= end) return "";
+
+	for (; *text && p < end; text++)
+	{
+		switch (*text)
+		{
+		case '&':	entity = "&amp;";	break;
+		case '<':	entity = "&lt;";	break;
+		case '>':	entity = "&gt;";	break;
+		case '"':	entity = "&quot;";	break;
+		case '\'':	entity = "&apos;";	break;
+		default:	*p++ = *text;		continue;
+		}
+
+		if (p + strlen (entity) > end) break;
+		p = stpcpy (p, entity);
+	}
+
+	*p++ = '\0';
+	arenalen = p - arena;
+
+	return s;
+}
+
+/* Formatted text in a pango span of a color, or just the text without one */
+const char *
+genmon_span (const char *color, const char *fmt, ...)
+{
+	va_list ap;
+	char *text;
+
+	va_start (ap, fmt);
+	text = vformat (fmt, ap);
+	va_end (ap);
+
+	return color ? genmon_format ("<span foreground=\"%s\">%s</span>", color, text) : text;
+}
+
+/* The icon is a file name, not markup, the plugin takes it as it is */
+void
+genmon_out_img (void)
+{
+	if (genmon_showicon) genmon_out ("<img>%s</img>\n", genmon_iconfile);
+}
+
+void
+genmon_out_bar (int percent)
+{
+	genmon_out ("<bar>%d</bar>\n", percent);
+}
+
+/* Write the output with a single write, as the plugin reads it all once the
+ * monitor exits. Returns -1 when it could not be written.
+ */
+int
+genmon_out_flush (void)
+{
+	const char *p = outbuf;
+	ssize_t n;
+
+	while (outlen > 0)
+	{
+		if ((n = write (STDOUT_FILENO, p, outlen)) < 0)
+		{
+			if (errno == EINTR) continue;
+			return -1;
+		}
+
+		p += n;
+		outlen -= n;
+	}
+
+	outlen = arenalen = 0;
+	return 0;
+}
+
+/* The icon is in ~/.genmon-icon, named after the monitor unless -i says
+ * otherwise.
+ */
+void
+genmon_icon_init (const char *prog)
+{
+	char *home = getenv ("HOME");
+	assert (home != NULL);
+
+	snprintf (genmon_iconfile, sizeof (genmon_iconfile), "%s/.genmon-icon/%s.png", home, prog);
+}
+
+/* -i on its own turns the icon off, -iFILE names one, in ~/.genmon-icon when
+ * it is not an absolute path.
+ */
+void
+genmon_icon_option (const char *arg)
+{
+	if (!arg)
+		genmon_showicon = 0;
+	else if (*arg == '/')
+		snprintf (genmon_iconfile, sizeof (genmon_iconfile), "%s", arg);
+	else
+		snprintf (genmon_iconfile, sizeof (genmon_iconfile), "%s/.genmon-icon/%s", getenv ("HOME"), arg);
+}
+
+void
+genmon_show_version (const char *prog, const char *vers)
+{
+	printf ("%s %s - (C) 2013 Digirium, see <https://github.com/Digirium>\n", prog, vers);
+	printf ("Released under the GNU GPL.\n\n");
+}
+
+/* Switch to timing another phase. Returns the one before, to switch back to. */
+int
+genmon_phase (int next)
+{
+	unsigned long long int now = genmon_nanos ();
+	int prev = phase;
+
+	if (phasestart)	phasenanos[phase] += now - phasestart;
+	else		runstart = now;
+
+	phasestart = now;
+	phase = next;
+
+	return prev;
+}
+
+/* A counter of /proc/self/io, or 0 */
+static unsigned long long int
+io_counter (const char *io, const char *name)
+{
+	const char *p = strstr (io, name);
+
+	return p ? strtoull (p + strlen (name), NULL, 10) : 0;
+}
+
+static void
+report (void)
+{
+	static const char *names[GENMON_PHASES] = { "options", "parse", "cache read", "helper", "cache write", "output" };
+	static const char *keys[GENMON_PHASES] = { "options", "parse", "cache_read", "helper", "cache_write", "output" };
+	struct rusage self;
+	char io[1024];
+	int i;
+
+	genmon_phase (phase);
+
+	/* Counted up to this read, which is not. It is of this process, not under
+	 * any root, so genmon_read_file is not used.
+	 */
+	int fd = open ("/proc/self/io", O_RDONLY), len = (fd < 0) ? -1 : read (fd, io, sizeof (io) - 1);
+
+	if (fd >= 0) close (fd);
+	io[(len > 0) ? len : 0] = '\0';
+
+	/* Helpers run in the background, their usage is had from the runs */
+	getrusage (RUSAGE_SELF, &self);
+
+	unsigned long long int total = phasestart - runstart;
+	unsigned long long int bytes = io_counter (io, "rchar: "), reads = io_counter (io, "syscr: "),
+		writes = io_counter (io, "syscw: ");
+
+	if (genmon_debug & GENMON_DEBUG)
+	{
+		fprintf (stderr, "%s:", debugprog);
+		for (i = 0; i < GENMON_PHASES; i++) fprintf (stderr, " %s %.3fms,", names[i], phasenanos[i] / 1e6);
+		fprintf (stderr, " total %.3fms\n", total / 1e6);
+
+		fprintf (stderr, "%s: read %llu bytes, %llu read and %llu write calls, peak RSS %ldK, helpers %ldK\n",
+			debugprog, bytes, reads, writes, self.ru_maxrss, genmon_helper_maxrss);
+	}
+
+	if (genmon_debug & GENMON_STATS)
+	{
+		fprintf (stderr, "prog=%s", debugprog);
+		for (i = 0; i < GENMON_PHASES; i++) fprintf (stderr, " %s_us=%llu", keys[i], phasenanos[i] / 1000);
+		fprintf (stderr, " total_us=%llu read_bytes=%llu read_calls=%llu write_calls=%llu maxrss_kb=%ld helper_maxrss_kb=%ld\n",
+			total / 1000, bytes, reads, writes, self.ru_maxrss, genmon_helper_maxrss);
+	}
+}
+
+/* -d or -s, the report is made however the monitor exits */
+void
+genmon_debug_option (const char *prog, int flag)
+{
+	if (!genmon_debug) atexit (report);
+
+	genmon_debug |= flag;
+	debugprog = prog;
+}
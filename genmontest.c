@@ -0,0 +1,143 @@
+/*
+ * genmontest.c - Checks of the rates worked out for the XFCE genmon plugin monitors.
+ * Copyright (C) 2013 Digirium, see <https://github.com/Digirium/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+static char *prog = "genmontest";
+
+#include <stdio.h>
+#include <string.h>
+
+#include "genmon.h"
+
+#define SECOND		1000000000ULL
+
+static int tests = 0, failed = 0;
+
+static void
+check_rate (const char *name, unsigned long long int count, unsigned long long int prevcount,
+	unsigned long long int nanos, unsigned long long int expect)
+{
+	unsigned long long int rate = genmon_rate (count, prevcount, nanos);
+
+	tests++;
+
+	if (rate != expect)
+	{
+		fprintf (stderr, "%s: %s: rate %llu, expected %llu\n", prog, name, rate, expect);
+		failed++;
+	}
+}
+
+static void
+check_float (const char *name, float value, float expect)
+{
+	tests++;
+
+	if (value < expect * 0.999 - 0.001 || value > expect * 1.001 + 0.001)
+	{
+		fprintf (stderr, "%s: %s: %g, expected %g\n", prog, name, value, expect);
+		failed++;
+	}
+}
+
+/* Counters as network interfaces keep them */
+static void
+test_rates (void)
+{
+	/* 400 Gbit/s is 50 GB a second, past anything 32 bits hold */
+	check_rate ("400 Gbit/s", 1000000000000000ULL + 50000000000ULL, 1000000000000000ULL, SECOND, 50000000000ULL);
+	check_rate ("400 Gbit/s over an hour", 180000000000000ULL, 0, 3600 * SECOND, 50000000000ULL);
+	check_rate ("400 Gbit/s over 1 ms", 50000000ULL, 0, SECOND / 1000, 50000000000ULL);
+	check_rate ("idle", 123456789ULL, 123456789ULL, SECOND, 0);
+
+	/* A 32 bit counter that wrapped in the interval */
+	check_rate ("wrap", 0x100, 0xFFFFFF00ULL, SECOND, 0x200);
+	check_rate ("wrap at 1 Gbit/s", (4000000000ULL + 125000000ULL) & 0xFFFFFFFFULL, 4000000000ULL, SECOND, 125000000ULL);
+	check_rate ("wrap at 10 Gbit/s", (4000000000ULL + 1250000000ULL) & 0xFFFFFFFFULL, 4000000000ULL, SECOND, 1250000000ULL);
+	check_rate ("wrap over 2 s", 1000000ULL, 3000000000ULL, 2 * SECOND, (0x100000000ULL + 1000000ULL - 3000000000ULL) / 2);
+
+	/* One that was reset, as by the interface going down and up */
+	check_rate ("reset", 1000000ULL, 3000000000ULL, SECOND, 0);
+	check_rate ("reset to 0", 0, 2000000000ULL, SECOND / 10, 0);
+	check_rate ("reset of 64 bits", 1000ULL, 5000000000000ULL, SECOND, 0);
+	check_rate ("reset after 1 ms", 0x100, 0xF0000000ULL, SECOND / 1000, 0);
+	check_rate ("wrap after 1 ms", 0x100, 0xFFFFFF00ULL, SECOND / 1000, 0x200 * 1000);
+
+	/* Intervals too short or long to give a rate */
+	check_rate ("clock gap", 2000000000ULL, 1000000000ULL, 3600 * SECOND + 1, 0);
+	check_rate ("suspend", 2000000000ULL, 1000000000ULL, 86400 * SECOND, 0);
+	check_rate ("same sample", 2000000000ULL, 1000000000ULL, 0, 0);
+	check_rate ("too short", 2000000000ULL, 1000000000ULL, GENMON_RATE_MINNANOS - 1, 0);
+}
+
+/* Counters as /proc/diskstats keeps them */
+static void
+test_disk_io (void)
+{
+	unsigned long long int prev[GENMON_DISKSTATS], stats[GENMON_DISKSTATS];
+	struct genmon_diskio io;
+
+	/* reads, merged, sectors, ticks, writes, merged, sectors, ticks, in flight, io ticks, in queue */
+	unsigned long long int base[GENMON_DISKSTATS] = { 1000, 0, 80000, 2000, 500, 0, 40000, 3000, 0, 5000, 5000 };
+
+	memcpy (prev, base, sizeof (prev));
+	memcpy (stats, base, sizeof (stats));
+	stats[0] += 100;
+	stats[2] += 2048;
+	stats[3] += 150;
+	stats[4] += 100;
+	stats[6] += 4096;
+	stats[7] += 250;
+	stats[9] += 500;
+
+	genmon_disk_io (stats, prev, SECOND, &io);
+	check_float ("disk read rate", io.readrate, 2048 * 512);
+	check_float ("disk write rate", io.writerate, 4096 * 512);
+	check_float ("disk iops", io.iops, 200);
+	check_float ("disk await", io.await, 2);
+	check_float ("disk util", io.util, 50);
+
+	/* A 32 bit kernel wraps the sectors */
+	prev[2] = 0xFFFFF000ULL;
+	stats[2] = 0x800;
+	genmon_disk_io (stats, prev, SECOND, &io);
+	check_float ("disk read rate wrapped", io.readrate, 0x1800 * 512);
+
+	/* Counters of a disk removed and added again start over */
+	memcpy (prev, stats, sizeof (prev));
+	prev[0] = prev[4] = 3000000000ULL;
+	prev[2] = prev[6] = 3500000000ULL;
+	prev[3] = prev[7] = prev[9] = 3000000000ULL;
+	genmon_disk_io (base, prev, SECOND, &io);
+	check_float ("disk read rate reset", io.readrate, 0);
+	check_float ("disk write rate reset", io.writerate, 0);
+	check_float ("disk iops reset", io.iops, 0);
+	check_float ("disk util reset", io.util, 0);
+
+	genmon_disk_io (stats, base, 7200 * SECOND, &io);
+	check_float ("disk clock gap", io.iops, 0);
+}
+
+int
+main (void)
+{
+	test_rates ();
+	test_disk_io ();
+
+	printf ("%s: %d tests, %d failed\n", prog, tests, failed);
+
+	return failed ? 1 : 0;
+}
@@ -22,42 +22,33 @@ static char *vers = "1.0.0";
 #include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
+
+#include "genmon.h"
 
 /* Option parsing */
-static char iconfile[256];
-static int debug = 0;
 static int showbar = 0;
-static int showicon = 1;
-
-static void
-show_version (void)
-{
-	printf ("%s %s - (C) 2013 Digirium, see <https://github.com/Digirium>\n", prog, vers);
-	printf ("Released under the GNU GPL.\n\n");
-}
+static int showhistory = 0;
 
 static void
 show_help (void)
 {
-	show_version ();
-	
-	printf ("-d --debug		Display debugging output.\n");
-	printf ("-h --help		Display this help.\n");
-	printf ("-i[FILE] --icon[=FILE]	Set the icon filename, or disable the icon.\n");
+	genmon_show_version (prog, vers);
+
+	printf (GENMON_HELP_DEBUG);
+	printf (GENMON_HELP_HELP);
+	printf ("-H --history		Display usage history in the tool tip.\n");
+	printf (GENMON_HELP_ICON);
 	printf ("-p --percentbar		Display the percent bar.\n");
-	printf ("-v --version		Display version information.\n");
+	printf (GENMON_HELP_STATS);
+	printf (GENMON_HELP_VERSION);
 
-	printf ("\nLong options may be passed with a single dash.\n\n");
+	printf (GENMON_HELP_LONG);
 }
 
 static void
 get_options (int argc, char *argv[])
 {
-	char *home = getenv ("HOME");
-	assert (home != NULL);
-
-	sprintf (iconfile, "%s/.genmon-icon/%s.png", home, prog);
+	genmon_icon_init (prog);
 
 	if (argc == 1) return;
 
@@ -65,48 +56,48 @@ get_options (int argc, char *argv[])
 	{
 		{ "debug",	no_argument,		0, 'd' },
 		{ "help",	no_argument,		0, 'h' },
+		{ "history",	no_argument,		0, 'H' },
 		{ "icon",	optional_argument,	0, 'i' },
 		{ "percentbar",	no_argument,		0, 'p' },
+		{ "stats",	no_argument,		0, 's' },
 		{ "version",	no_argument,		0, 'v' },
 		{ 0,0,0,0 }
 	};
 
 	int opt, opti;
 
-	while ((opt = getopt_long (argc, argv, "dhi::pv", long_opts, &opti)))
+	while ((opt = getopt_long (argc, argv, "dhHi::psv", long_opts, &opti)))
 	{
 		if (opt == EOF) break;
 
 		switch (opt)
 		{
 		case 'd':
-			debug = 1;
+			genmon_debug_option (prog, GENMON_DEBUG);
 			break;
 
 		case 'h':
 			show_help ();
 			exit (0);
 
-		case 'i':
-			if (!optarg)
-			{
-				showicon = 0;
-				break;
-			}
-
-			if (*optarg == '/')
-				strcpy (iconfile, optarg);
-			else
-				sprintf (iconfile, "%s/.genmon-icon/%s", home, optarg);
+		case 'H':
+			showhistory = 1;
+			break;
 
+		case 'i':
+			genmon_icon_option (optarg);
 			break;
 
 		case 'p':
 			showbar = 1;
 			break;
 
+		case 's':
+			genmon_debug_option (prog, GENMON_STATS);
+			break;
+
 		case 'v':
-			show_version ();
+			genmon_show_version (prog, vers);
 			exit (0);
 
 		default:
@@ -131,83 +122,43 @@ get_fw (unsigned int val, int fw)
 int
 main (int argc, char *argv[])
 {
+	genmon_phase (GENMON_OPTIONS);
 	get_options (argc, argv);
+	genmon_phase (GENMON_PARSE);
 
-	unsigned long long int memtotal = 0;
-	unsigned long long int memfree = 0;
-	unsigned long long int membuffers = 0;
-	unsigned long long int memcached = 0;
-	unsigned long long int memused;
-	int k = 1024, ret, found = 0;
-	char buffer[128];
+	unsigned long long int memtotal, memfree, membuffers, memcached, memused;
+	int k = 1024;
 
-	/* Obtain memory usage values. This is done by parsing memory usage statistics from
-	 * the psuedo-filesystem and just four lines from the output are used.
+	/* Obtain memory usage values. Take them from genmond when it is running,
+	 * otherwise parse memory usage statistics from the psuedo-filesystem, just
+	 * four lines from its output are used.
 	 */
-	FILE *file = fopen ("/proc/meminfo", "r");
-	assert (file != NULL);
+	struct genmond_sample sample;
 
-	while (fgets (buffer, 128, file))
+	if (!genmond_attach (&sample))
 	{
-		switch (buffer[0])
-		{
-		case 'M':
-			/* MemTotal */
-			if (strstr (buffer, "MemTotal:") == buffer)
-			{
-				ret = sscanf (buffer, "MemTotal: %llu kB", &memtotal);
-				assert (ret == 1);
-				found++;
-			}
-
-			/* MemFree */
-			else if (strstr (buffer, "MemFree:") == buffer)
-			{
-				ret = sscanf (buffer, "MemFree: %llu kB", &memfree);
-				assert (ret == 1);
-				found++;
-			}
+		int found = genmon_read_meminfo (&sample.mem);
+		assert (found == 4);
 
-			break;
-
-		case 'B':
-			/* Buffers */
-			if (strstr (buffer, "Buffers:") == buffer)
-			{
-				ret = sscanf (buffer, "Buffers: %llu kB", &membuffers);
-				assert (ret == 1);
-				found++;
-			}
-
-			break;
-
-		case 'C':
-			/* Cached */
-			if (strstr (buffer, "Cached:") == buffer)
-			{
-				ret = sscanf (buffer, "Cached: %llu kB", &memcached);
-				assert (ret == 1);
-				found++;
-			}
-
-			break;
-		}
-
-		/* The output may begin with the four values that need to be found. In any
-		 * case, when the 4th value is found quit the parsing loop.
-		 */
-		if (found == 4)
-			break;
+		/* Without genmond the history is kept here, a sample each run */
+		genmon_history_add ("mem", (sample.mem.total - sample.mem.free - sample.mem.buffers
+			- sample.mem.cached) * 100.0 / sample.mem.total, NULL);
 	}
 
+	memtotal	= sample.mem.total;
+	memfree		= sample.mem.free;
+	membuffers	= sample.mem.buffers;
+	memcached	= sample.mem.cached;
+
 	/* Process memory usage */
 	memused = memtotal - memfree - membuffers - memcached;
-	fclose (file);
 
 	/** XFCE GENMON XML **/
 
+	genmon_phase (GENMON_OUTPUT);
+
 	/* Icon */
-	if (showicon) printf ("<img>%s</img>\n", iconfile);
+	genmon_out_img ();
 
 	/* Pseudo-filesystem gave us values in KB, convert to MB */
 	unsigned long long int kused	= memused / k;
@@ -217,15 +168,22 @@ main (int argc, char *argv[])
 
 	/* Text */
 	int fw = get_fw(kused, get_fw(kcached, 1));
-	printf ("<txt>%*lluM %d%%\n%*lluM %lluM</txt>\n", fw, kused, percent, fw, kcached, kbuffer);
+	genmon_out ("<txt>%*lluM %d%%\n%*lluM %lluM</txt>\n", fw, kused, percent, fw, kcached, kbuffer);
 
 	/* Tool tip */
 	percent = ((memtotal - memfree) * 100) / memtotal;
-	printf ("<tool>Total memory available: %lluM\n", memtotal / k);
-	printf ("Memory currently being used: %lluM (%d%%)</tool>\n", (memtotal - memfree) / k, percent);
+	genmon_out ("<tool>Total memory available: %lluM\n", memtotal / k);
+	genmon_out ("Memory currently being used: %lluM (%d%%)", (memtotal - memfree) / k, percent);
+
+	struct genmon_summary summary[GENMON_WINDOWS];
+
+	if (showhistory && genmon_history_read ("mem", summary))
+		genmon_print_history ("Usage", summary, "%.0f%%", 1.0, 0.0);
+
+	genmon_out ("</tool>\n");
 
 	/* Percentage bar */
-	if (showbar) printf ("<bar>%d</bar>\n", percent);
+	if (showbar) genmon_out_bar (percent);
 
-	return 0;
+	return genmon_out_flush () ? 1 : 0;
 }
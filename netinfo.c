@@ -18,70 +18,76 @@
 static char *prog = "netinfo";
 static char *vers = "1.0.0";
 
-#include <assert.h>
+#include <fnmatch.h>
 #include <getopt.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <time.h>
 #include <unistd.h>
 
+#include "genmon.h"
+
 /* Option parsing */
-static int debug = 0;
-static char iconfile[256];
-static char *interface = NULL;
+static char **interfaces = NULL;
+static int patterns = 0;
+static int wanted = 0;
+static int pango = 0;
 static int showbps = 0;
-static int showicon = 1;
+static int showhistory = 0;
 
-static void
-show_version (void)
-{
-	printf ("%s %s - (C) 2013 Digirium, see <https://github.com/Digirium>\n", prog, vers);
-	printf ("Released under the GNU GPL.\n\n");
-}
+/* Pango colors, and the errors and drops per second at which they are used */
+static char *yellow = "yellow", *orange = "orange", *red = "red";
+static unsigned long long int thresholds[3] = { 1, 10, 100 };
 
 static void
 show_usage (void)
 {
-	printf ("Usage: %s [options] <networkinterface>\n", prog);
+	printf ("Usage: %s [options] <networkinterface|pattern>...\n", prog);
 }
 
 static void
 show_help (void)
 {
-	show_version ();
+	genmon_show_version (prog, vers);
 	show_usage ();
-	
-	printf ("\n-b --bitspersec		Display rates in bits/second.\n");
-	printf ("-d --debug		Display debugging output.\n");
-	printf ("-h --help		Display this help.\n");
-	printf ("-i[FILE] --icon[=FILE]	Set the icon filename, or disable the icon.\n");
-	printf ("-v --version		Display version information.\n");
 
-	printf ("\nLong options may be passed with a single dash.\n\n");
+	printf ("\n-b --bitspersec		Display rates in bits/second.\n");
+	printf (GENMON_HELP_DEBUG);
+	printf (GENMON_HELP_HELP);
+	printf ("-H --history		Display rate history in the tool tip.\n");
+	printf (GENMON_HELP_ICON);
+	printf ("-p --pango		Generate Pango Markup Language output.\n");
+	printf (GENMON_HELP_STATS);
+	printf ("-tN,N,N --thresholds=N,N,N	Set the errors and drops per second shown\n");
+	printf ("			in yellow, orange and red (default 1,10,100).\n");
+	printf (GENMON_HELP_VERSION);
+
+	printf (GENMON_HELP_LONG);
 }
 
 static void
 get_options (int argc, char *argv[])
 {
-	char *home = getenv ("HOME");
-	assert (home != NULL);
-
-	sprintf (iconfile, "%s/.genmon-icon/%s.png", home, prog);
+	genmon_icon_init (prog);
 
 	static struct option long_opts[] =
 	{
 		{ "bitspersec",	no_argument,		0, 'b' },
 		{ "debug",	no_argument,		0, 'd' },
 		{ "help",	no_argument,		0, 'h' },
+		{ "history",	no_argument,		0, 'H' },
 		{ "icon",	optional_argument,	0, 'i' },
+		{ "pango",	no_argument,		0, 'p' },
+		{ "stats",	no_argument,		0, 's' },
+		{ "thresholds",	required_argument,	0, 't' },
 		{ "version",	no_argument,		0, 'v' },
 		{ 0,0,0,0 }
 	};
 
 	int opt, opti;
 
-	while ((opt = getopt_long (argc, argv, "bdhi::v", long_opts, &opti)))
+	while ((opt = getopt_long (argc, argv, "bdhHi::pst:v", long_opts, &opti)))
 	{
 		if (opt == EOF) break;
 
@@ -92,27 +98,42 @@ get_options (int argc, char *argv[])
 			break;
 
 		case 'd':
-			debug = 1;
+			genmon_debug_option (prog, GENMON_DEBUG);
 			break;
 
 		case 'h':
 			show_help ();
 			exit (0);
 
+		case 'H':
+			showhistory = 1;
+			break;
+
 		case 'i':
-			if (!optarg)
-			{
-				showicon = 0;
-				break;
-			}
+			genmon_icon_option (optarg);
+			break;
 
-			if (*optarg == '/')	strcpy (iconfile, optarg);
-			else			sprintf (iconfile, "%s/.genmon-icon/%s", home, optarg);
+		case 'p':
+			/* Color the rates as the interfaces start to lose packets, yellow,
+			 * orange and then red as errors and drops per second rise.
+			 */
+			pango = 1;
+			break;
 
+		case 's':
+			genmon_debug_option (prog, GENMON_STATS);
+			break;
+
+		case 't':
+			if (sscanf (optarg, "%llu,%llu,%llu", thresholds, thresholds + 1, thresholds + 2) < 1)
+			{
+				fprintf (stderr, "%s: bad thresholds %s\n", prog, optarg);
+				exit (1);
+			}
 			break;
 
 		case 'v':
-			show_version ();
+			genmon_show_version (prog, vers);
 			exit (0);
 
 		default:
@@ -126,157 +147,427 @@ get_options (int argc, char *argv[])
 		exit (1);
 	}
 
-	interface = argv[optind];
+	/* Interfaces may be given as shell patterns, for example 'veth*' */
+	interfaces = argv + optind;
+	wanted = argc - optind;
+
+	for (opt = 0; opt < wanted; opt++)
+		if (strpbrk (interfaces[opt], "*?[")) patterns = 1;
+}
+
+/* The name of the state of the interfaces patterns match, after the patterns.
+ * No interface name has a colon in it.
+ */
+static const char *
+set_name (void)
+{
+	unsigned int h = 2166136261U;
+	const char *p;
+	int n;
+
+	/* Each with its terminating null, so 'a*' 'b' differs from 'a' '*b' */
+	for (n = 0; n < wanted; n++)
+		for (p = interfaces[n]; ; p++)
+		{
+			h = (h ^ (unsigned char)*p) * 16777619U;
+			if (!*p) break;
+		}
+
+	return genmon_format ("netinfo:%08x", h);
+}
+
+static int
+is_wanted (const char *name)
+{
+	int n;
+
+	for (n = 0; n < wanted; n++)
+		if (patterns ? fnmatch (interfaces[n], name, 0) == 0 : strcmp (interfaces[n], name) == 0)
+			return 1;
+
+	return 0;
 }
 
 enum RXTX2S { RX = 1, TX = 0 };
 
-static void
-rxtx2s (char *line, float rate, unsigned long long int total, int rxflag)
+/* A rate too small to show, under one of the units displayed */
+static int
+is_idle (unsigned long long int rate)
+{
+	return showbps ? (rate * 8 < 1000) : (rate < 1024);
+}
+
+static const char *
+rxtx2s (unsigned long long int rate, unsigned long long int total, int rxflag)
 {
 	static char *Rx = "Rx", *Tx = "Tx";
 
-	if (rate == 0.0)	/* Show totals up/down in units of 1,048,576 bytes */
+	if (rate == 0)		/* Show totals up/down in units of 1,073,741,824 bytes, or 1024 times that */
 	{
-		float gb = total / 1073741824.0;
-		sprintf (line, "%6.3fG", gb);
+		if (total < (1ULL << 40) * 1000 / 1024)	return genmon_format ("%6.3fG", total / (double)(1ULL << 30));
+		else					return genmon_format ("%6.3fT", total / (double)(1ULL << 40));
 	}
-	else if (showbps)	/* Show rates in decimal units of 1000 or 1000000 bits/second */
+	else if (showbps)	/* Show rates in decimal units of 1000 up to 10^12 bits/second */
 	{
-		if (rate < 1000.0)	sprintf (line, "%s %3dk", rxflag ? Rx : Tx, (int)rate);
-		else			sprintf (line, "%6.3fm", rate / 1000.0);
+		unsigned long long int bits = rate * 8;
+
+		if (bits < 1000000ULL)			return genmon_format ("%s %3dk", rxflag ? Rx : Tx, (int)(bits / 1000));
+		else if (bits < 1000000000ULL)		return genmon_format ("%6.3fm", bits / 1e6);
+		else if (bits < 1000000000000ULL)	return genmon_format ("%6.3fg", bits / 1e9);
+		else					return genmon_format ("%6.3ft", bits / 1e12);
 	}
-	else			/* Show rates in binary units of 1024 bytes/second */
+	else			/* Show rates in binary units of 1024 up to 1024^4 bytes/second */
 	{
-		if (rate < 1000.0)	sprintf (line, "%s %3dK", rxflag ? Rx : Tx, (int)rate);
-		else			sprintf (line, "%6dK", (int)rate);
+		unsigned long long int kbytes = rate / 1024;
+
+		if (kbytes < 1000)			return genmon_format ("%s %3dK", rxflag ? Rx : Tx, (int)kbytes);
+		else if (kbytes < 1000000)		return genmon_format ("%6dK", (int)kbytes);
+		else if (kbytes < (1ULL << 30))		return genmon_format ("%6.2fG", rate / (double)(1ULL << 30));
+		else					return genmon_format ("%6.2fT", rate / (double)(1ULL << 40));
 	}
 }
 
+enum RXTX { Bytes = 0, Packets, Errs, Drop, Fifo, Frame, Compressed, Multicast };
+
+/* Packets per second to string */
+static const char *
+pps2s (unsigned long long int rate)
+{
+	if	(rate < 10000)		return genmon_format ("%llu", rate);
+	else if	(rate < 10000000)	return genmon_format ("%.1fk", rate / 1000.0);
+	else				return genmon_format ("%.1fM", rate / 1000000.0);
+}
+
+/* The pango color for the errors and drops per second, NULL when there are
+ * too few to show or pango is off.
+ */
+static char *
+color_of (const unsigned long long int *raterx, const unsigned long long int *ratetx)
+{
+	unsigned long long int lost = raterx[Errs] + raterx[Drop] + ratetx[Errs] + ratetx[Drop];
+
+	if (!pango || lost < thresholds[0])	return NULL;
+	else if (lost < thresholds[1])		return yellow;
+	else if (lost < thresholds[2])		return orange;
+	else					return red;
+}
+
+struct iface
+{
+	char name[32];
+	unsigned long long int rx[8], tx[8];
+	unsigned long long int raterx[8], ratetx[8];	/* per second */
+	int ifindex;
+	struct genmon_state *state;
+	struct genmon_net_state prev;
+	int hasprev;
+};
+
+static struct iface iface[GENMON_MAXIFACES];
+
 int
 main (int argc, char *argv[])
 {
+	genmon_phase (GENMON_OPTIONS);
 	get_options (argc, argv);
+	genmon_phase (GENMON_PARSE);
 
-	/* Obtain network statistics for the interface that was specified. These
-	 * will be compared with previous statistics kept in the cache and used
-	 * to work out network speeds.
-	 */
-	enum RXTX { Bytes = 0, Packets, Errs, Drop, Fifo, Frame, Compressed, Multicast };
 	unsigned long long int rx[8], tx[8];
+	char name[64], path[PATH_MAX];
+	int ifaces = 0, sampled = 0, loop, n;
+
+	/* When genmond is sampling every interface asked for, take its counters and
+	 * rates per second instead of reading the pseudo-file and the state.
+	 */
+	struct genmond_sample sample;
+
+	if (!patterns && wanted <= GENMON_MAXNETS && genmond_attach (&sample))
+	{
+		for (n = 0; n < wanted; n++)
+		{
+			for (loop = 0; loop < sample.nets; loop++)
+				if (strcmp (sample.net[loop].interface, interfaces[n]) == 0) break;
+
+			if (loop == sample.nets) break;
 
-	FILE *file = fopen ("/proc/net/dev", "r");
-	assert (file != NULL);
+			struct genmond_net *net = sample.net + loop;
 
-	char buffer[1024], format[1024];
-	int loop, ret, down = 1;
+			if (net->down) continue;
+
+			strcpy (iface[ifaces].name, net->interface);
+			memcpy (iface[ifaces].rx, net->rx, sizeof (net->rx));
+			memcpy (iface[ifaces].tx, net->tx, sizeof (net->tx));
+			memcpy (iface[ifaces].raterx, net->raterx, sizeof (net->raterx));
+			memcpy (iface[ifaces].ratetx, net->ratetx, sizeof (net->ratetx));
+			ifaces++;
+		}
 
-	for (loop = 0; loop < 8; loop++) rx[loop] = tx[loop] = 0;
+		/* An interface genmond is not sampling, fall back to doing it all here */
+		if (n < wanted) ifaces = 0;
+		else		sampled = 1;
+	}
 
-	if (file)
+	if (!sampled)
 	{
-		sprintf (format, " %5s:", interface);
+		/* Interfaces given by name are looked up over netlink, by the index kept
+		 * in their state, which takes the same time however many interfaces the
+		 * host has. The state is opened here for that and kept for the update.
+		 */
+		int fd = patterns ? -1 : genmon_netlink_open ();
+		int netlink = (fd >= 0);
+
+		for (n = 0; netlink && n < wanted && ifaces < GENMON_MAXIFACES; n++)
+		{
+			struct iface *i = iface + ifaces;
 
-		for (loop = 0; loop < 16; loop++) strcat (format, " %llu");
+			snprintf (i->name, 32, "%s", interfaces[n]);
+			snprintf (name, 64, "netinfo.%.31s", i->name);
 
-		while (fgets (buffer, 1024, file))
-			if (strstr (buffer, interface))
+			i->state = genmon_state_open (name, sizeof (struct genmon_net_state), 1);
+			i->hasprev = i->state && genmon_state_read (i->state, GENMON_NET, &i->prev, sizeof (i->prev));
+			i->ifindex = i->hasprev ? i->prev.ifindex : 0;
+
+			switch (genmon_netlink_link (fd, i->name, &i->ifindex, i->rx, i->tx))
 			{
-				ret = sscanf (buffer, format,
-					rx, rx + 1, rx + 2, rx + 3, rx + 4, rx + 5, rx + 6, rx + 7,
-					tx, tx + 1, tx + 2, tx + 3, tx + 4, tx + 5, tx + 6, tx + 7);
+			case 1:
+				ifaces++;
+				break;
 
-				assert (ret == 16);
-				down = 0;
+			case 0:		/* down */
+				if (i->state) genmon_state_close (i->state, sizeof (struct genmon_net_state));
 				break;
+
+			default:
+				netlink = 0;
+				ifaces++;
 			}
+		}
 
-		fclose (file);
-	}
+		if (fd >= 0) close (fd);
 
-	/* If the pseudo-file did not mention the interface, indicate that the
-	 * network connection is down in the generic monitor and quit.
-	 */
-	if (down)
-	{
-		if (showicon) printf ("<img>%s</img>\n", iconfile);
-		printf ("<txt>   Down\n</txt>\n");
-		printf ("<tool>%s is down</tool>", interface);
-		unlink (format);
-		return 3;
-	}
+		/* Otherwise obtain network statistics for the interfaces that were
+		 * specified in one pass over the pseudo-file. Names are matched exactly,
+		 * or as patterns.
+		 */
+		if (!netlink)
+		{
+			for (n = 0; n < ifaces; n++)
+				if (iface[n].state) genmon_state_close (iface[n].state, sizeof (struct genmon_net_state));
+
+			memset (iface, 0, ifaces * sizeof (*iface));
+			ifaces = 0;
+
+			const char *p = genmon_read_proc ("/proc/net/dev");
+
+			while (p && (p = genmon_parse_netdev (p, name, 32, rx, tx)))
+				if (name[0] && ifaces < GENMON_MAXIFACES && is_wanted (name))
+				{
+					strcpy (iface[ifaces].name, name);
+					memcpy (iface[ifaces].rx, rx, sizeof (rx));
+					memcpy (iface[ifaces].tx, tx, sizeof (tx));
+					ifaces++;
+				}
+		}
 
-	/* Need to know elapsed time to work out data rates. Find current time and
-	 * get the previous time from the cache.
-	 */
-	struct timespec ts;
-	clock_gettime (CLOCK_MONOTONIC_RAW, &ts);
-	unsigned long long int nanos = ts.tv_sec * 1000000000LL + ts.tv_nsec;
-	unsigned long long int prevrx, prevtx, prevnanos;
-	float raterx = 0.0, ratetx = 0.0;
-
-	/* Prepare to read and update the cache. It contains three previous values,
-	 * bytes read and written and the time.
-	 */
-	sprintf (format, "/dev/shm/netinfo.%s.%d", interface, getuid ());
+		/* Need to know elapsed time to work out data rates. Find current time and
+		 * get the previous time from the state file of each interface. It contains
+		 * all of the counters, the time and the netlink interface index.
+		 */
+		unsigned long long int nanos = genmon_nanos ();
 
-	if ((file = fopen (format, "r+")))
-	{
-		if (fgets (buffer, 1024, file))
+		/* Those of patterns are all in one state, written back each run with
+		 * only the interfaces there now, so those gone do not pile up.
+		 */
+		static struct genmon_netset_state set, prevset;
+		struct genmon_state *setstate = NULL;
+
+		if (patterns && (setstate = genmon_state_open (set_name (), sizeof (set), 1)))
+			if (!genmon_state_read (setstate, GENMON_NETSET, &prevset, sizeof (prevset))
+				|| prevset.count < 0 || prevset.count > GENMON_MAXIFACES)
+				prevset.count = 0;
+
+		for (n = 0; n < ifaces; n++)
 		{
-			ret = sscanf (buffer, "%llu %llu %llu", &prevrx, &prevtx, &prevnanos);
-			assert (ret == 3);
+			struct iface *i = iface + n;
+			struct genmon_net_state cur;
 
-			if (showbps)
+			if (patterns)
 			{
-				/* Calculate kilobits per second */
-				float elapsed = (nanos - prevnanos) / 1000000.0;
-				raterx = ((rx[Bytes] - prevrx) * 8.0) / elapsed;
-				ratetx = ((tx[Bytes] - prevtx) * 8.0) / elapsed;
+				for (loop = 0; loop < prevset.count; loop++)
+					if (strncmp (prevset.name[loop], i->name, 32) == 0)
+					{
+						i->prev = prevset.net[loop];
+						i->hasprev = 1;
+						break;
+					}
+			}
+			else if (!i->state)
+			{
+				snprintf (name, 64, "netinfo.%.31s", i->name);
+
+				if (!(i->state = genmon_state_open (name, sizeof (cur), 1))) continue;
+
+				i->hasprev = genmon_state_read (i->state, GENMON_NET, &i->prev, sizeof (i->prev));
+			}
+
+			memcpy (cur.rx, i->rx, sizeof (cur.rx));
+			memcpy (cur.tx, i->tx, sizeof (cur.tx));
+			cur.nanos	= nanos;
+			cur.ifindex	= i->ifindex;
+
+			/* The clock only goes backwards over a reboot, which /dev/shm does
+			 * not survive, but a state file copied in could still be ahead.
+			 */
+			if (i->hasprev && cur.nanos > i->prev.nanos)
+				for (loop = 0; loop < 8; loop++)
+				{
+					i->raterx[loop] = genmon_rate (cur.rx[loop], i->prev.rx[loop], cur.nanos - i->prev.nanos);
+					i->ratetx[loop] = genmon_rate (cur.tx[loop], i->prev.tx[loop], cur.nanos - i->prev.nanos);
+				}
+
+			/* Update the state */
+			if (patterns)
+			{
+				strcpy (set.name[set.count], i->name);
+				set.net[set.count++] = cur;
 			}
 			else
 			{
-				/* Calculate kilobytes per second */
-				float elapsed = (nanos - prevnanos) / 1000000000.0;
-				raterx = (((float)(rx[Bytes] - prevrx)) / elapsed) / 1024.0;
-				ratetx = (((float)(tx[Bytes] - prevtx)) / elapsed) / 1024.0;
+				genmon_state_write (i->state, GENMON_NET, &cur, sizeof (cur));
+				genmon_state_close (i->state, sizeof (cur));
+			}
+
+			/* Without genmond the history is kept here, a sample each run. Not for
+			 * patterns though, that could match hundreds of interfaces.
+			 */
+			if (i->hasprev && !patterns)
+			{
+				snprintf (name, 64, "net.%.16s.rx", i->name);
+				genmon_history_add (name, i->raterx[Bytes], NULL);
+				snprintf (name, 64, "net.%.16s.tx", i->name);
+				genmon_history_add (name, i->ratetx[Bytes], NULL);
 			}
 		}
 
-		fseek (file, 0, SEEK_SET);
+		if (setstate)
+		{
+			genmon_state_write (setstate, GENMON_NETSET, &set, sizeof (set));
+			genmon_state_close (setstate, sizeof (set));
+		}
 	}
-	else	file = fopen (format, "w");
 
-	/* Update the cache */
-	fprintf (file, "%llu %llu %llu\n", rx[Bytes], tx[Bytes], nanos);
-	fclose (file);
+	/* If none of the interfaces were found, indicate that the network
+	 * connection is down in the generic monitor and quit.
+	 */
+	if (!ifaces)
+	{
+		genmon_phase (GENMON_OUTPUT);
+		genmon_out_img ();
+		genmon_out ("<txt>   Down\n</txt>\n");
+		genmon_out ("<tool>");
+		for (n = 0; n < wanted; n++) genmon_out ("%s%s", n ? " " : "", genmon_escape (interfaces[n]));
+		genmon_out (" %s down</tool>", (wanted > 1 || patterns) ? "are" : "is");
+
+		for (n = 0; !patterns && n < wanted; n++)
+		{
+			snprintf (name, 64, "netinfo.%.31s", interfaces[n]);
+			unlink (genmon_state_path (name, path, sizeof (path)));
+		}
+
+		genmon_out_flush ();
+		return 3;
+	}
+
+	/* Aggregate over all of the interfaces */
+	unsigned long long int totalrx[8] = { 0 }, totaltx[8] = { 0 };
+	unsigned long long int raterx[8] = { 0 }, ratetx[8] = { 0 };
+
+	for (n = 0; n < ifaces; n++)
+		for (loop = 0; loop < 8; loop++)
+		{
+			totalrx[loop]	+= iface[n].rx[loop];
+			totaltx[loop]	+= iface[n].tx[loop];
+			raterx[loop]	+= iface[n].raterx[loop];
+			ratetx[loop]	+= iface[n].ratetx[loop];
+		}
 
 	/** XFCE GENMON XML **/
 
-	/* Icon */
+	genmon_phase (GENMON_OUTPUT);
 
-	printf ("<img>%s</img>\n", iconfile);
+	/* Icon */
 
-	/* If NIC is inactive, or close to inactive, show totals instead */
-	if (raterx < 1.0 && ratetx < 1.0) raterx = ratetx = 0.0;
+	genmon_out_img ();
 
-	char in[64], out[64];
+	const char *in, *out, *color = color_of (raterx, ratetx);
 
 	/* Text */
 
-	rxtx2s (in,  raterx, rx[Bytes], RX);
-	rxtx2s (out, ratetx, tx[Bytes], TX);
+	/* If NIC is inactive, or close to inactive, show totals instead */
+	if (is_idle (raterx[Bytes]) && is_idle (ratetx[Bytes]))
+	{
+		in  = rxtx2s (0, totalrx[Bytes], RX);
+		out = rxtx2s (0, totaltx[Bytes], TX);
+	}
+	else
+	{
+		in  = rxtx2s (raterx[Bytes], totalrx[Bytes], RX);
+		out = rxtx2s (ratetx[Bytes], totaltx[Bytes], TX);
+	}
 
-	printf ("<txt>%s\n%s</txt>\n", in, out);
+	genmon_out ("<txt>%s</txt>\n", genmon_span (color, "%s\n%s", in, out));
 
 	/* Tool tip */
 
-	rxtx2s (in,  0.0, rx[Bytes], RX);
-	rxtx2s (out, 0.0, tx[Bytes], TX);
+	if (ifaces == 1 && !patterns)
+		genmon_out ("<tool>Network interface: %s\n", genmon_escape (iface[0].name));
+	else
+	{
+		/* One line for each interface, showing rates when it is active */
+		genmon_out ("<tool>Network interfaces: %d\n", ifaces);
 
-	printf ("<tool>Network interface: %s\n", interface);
-	printf ("Total data received: %s\n", in);
-	printf ("Total data sent: %s</tool>\n", out);
+		for (n = 0; n < ifaces && n < 32; n++)
+		{
+			struct iface *i = iface + n;
 
-	return 0;
+			if (is_idle (i->raterx[Bytes]) && is_idle (i->ratetx[Bytes]))
+			{
+				in  = rxtx2s (0, i->rx[Bytes], RX);
+				out = rxtx2s (0, i->tx[Bytes], TX);
+			}
+			else
+			{
+				in  = rxtx2s (i->raterx[Bytes], i->rx[Bytes], RX);
+				out = rxtx2s (i->ratetx[Bytes], i->tx[Bytes], TX);
+			}
+
+			genmon_out ("%s\n", genmon_span (color_of (i->raterx, i->ratetx), "%s: %s %s", genmon_escape (i->name), in, out));
+		}
+
+		if (ifaces > 32) genmon_out ("... and %d more\n", ifaces - 32);
+	}
+
+	genmon_out ("Total data received: %s\n", rxtx2s (0, totalrx[Bytes], RX));
+	genmon_out ("Total data sent: %s", rxtx2s (0, totaltx[Bytes], TX));
+
+	if (showhistory && ifaces == 1 && !patterns)
+	{
+		struct genmon_summary summary[GENMON_WINDOWS];
+		char *fmt = showbps ? "%.0fk" : "%.0fK";
+		float scale = showbps ? 8.0 / 1000.0 : 1.0 / 1024.0;
+
+		snprintf (name, 64, "net.%.16s.rx", iface[0].name);
+		if (genmon_history_read (name, summary)) genmon_print_history ("Rx", summary, fmt, scale, 0.0);
+
+		snprintf (name, 64, "net.%.16s.tx", iface[0].name);
+		if (genmon_history_read (name, summary)) genmon_print_history ("Tx", summary, fmt, scale, 0.0);
+	}
+
+	/* Packets, and those lost, per second */
+	genmon_out ("\nPackets/s: Rx %s Tx %s\n", pps2s (raterx[Packets]), pps2s (ratetx[Packets]));
+	genmon_out ("Errors/s: Rx %s Tx %s\n", pps2s (raterx[Errs]), pps2s (ratetx[Errs]));
+	genmon_out ("%s</tool>\n", genmon_span (color_of (raterx, ratetx), "Drops/s: Rx %s Tx %s",
+		pps2s (raterx[Drop]), pps2s (ratetx[Drop])));
+
+	return genmon_out_flush () ? 1 : 0;
 }
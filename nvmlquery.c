@@ -0,0 +1,183 @@
+/*
+ * nvmlquery.c - NVML query helper for the nvidiainfo monitor.
+ * Copyright (C) 2013 Digirium, see <https://github.com/Digirium/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+static char *prog = "nvmlquery";
+static char *vers = "1.0.0";
+
+#include <dlfcn.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Option parsing */
+static int debug = 0;
+static unsigned int gpu = 0;
+static char *library = "libnvidia-ml.so.1";
+
+/* The few NVML calls used, looked up with dlsym so that nothing needs the
+ * NVIDIA headers or libraries to build, and a machine without them just gets
+ * an exit status of 1. All return 0 on success.
+ */
+typedef void *nvmlDevice_t;
+
+struct nvml_memory
+{
+	unsigned long long int total, free, used;	/* bytes */
+};
+
+#define NVML_TEMPERATURE_GPU	0
+#define NVML_CLOCK_GRAPHICS	0
+#define NVML_CLOCK_MEM		2
+
+static struct
+{
+	int (*init) (void);
+	int (*shutdown) (void);
+	int (*driver_version) (char *version, unsigned int length);
+	int (*device_by_index) (unsigned int index, nvmlDevice_t *device);
+	int (*temperature) (nvmlDevice_t device, int sensor, unsigned int *temp);
+	int (*memory) (nvmlDevice_t device, struct nvml_memory *memory);
+	int (*clock) (nvmlDevice_t device, int type, unsigned int *clock);
+} nvml;
+
+static struct { const char *name; void **func; } symbols[] =
+{
+	{ "nvmlInit_v2",			(void **)&nvml.init },
+	{ "nvmlShutdown",			(void **)&nvml.shutdown },
+	{ "nvmlSystemGetDriverVersion",		(void **)&nvml.driver_version },
+	{ "nvmlDeviceGetHandleByIndex_v2",	(void **)&nvml.device_by_index },
+	{ "nvmlDeviceGetTemperature",		(void **)&nvml.temperature },
+	{ "nvmlDeviceGetMemoryInfo",		(void **)&nvml.memory },
+	{ "nvmlDeviceGetClockInfo",		(void **)&nvml.clock },
+	{ 0,0 }
+};
+
+static void
+show_version (void)
+{
+	printf ("%s %s - (C) 2013 Digirium, see <https://github.com/Digirium>\n", prog, vers);
+	printf ("Released under the GNU GPL.\n\n");
+}
+
+static void
+show_help (void)
+{
+	show_version ();
+
+	printf ("-d --debug		Display debugging output.\n");
+	printf ("-gN --gpu=N		Query GPU N (default 0).\n");
+	printf ("-h --help		Display this help.\n");
+	printf ("-lLIB --library=LIB	Load NVML from LIB (default libnvidia-ml.so.1).\n");
+	printf ("-v --version		Display version information.\n");
+
+	printf ("\nPrints the driver version, GPU temperature, used memory in MiB and the\n");
+	printf ("clocks on separate lines, in the order nvidiainfo queries nvidia-settings.\n");
+	printf ("\nLong options may be passed with a single dash.\n\n");
+}
+
+static void
+get_options (int argc, char *argv[])
+{
+	static struct option long_opts[] =
+	{
+		{ "debug",	no_argument,		0, 'd' },
+		{ "gpu",	required_argument,	0, 'g' },
+		{ "help",	no_argument,		0, 'h' },
+		{ "library",	required_argument,	0, 'l' },
+		{ "version",	no_argument,		0, 'v' },
+		{ 0,0,0,0 }
+	};
+
+	int opt, opti;
+
+	/* A stand-in library may be given in the environment, as for testing */
+	if (getenv ("GENMON_NVML")) library = getenv ("GENMON_NVML");
+
+	while ((opt = getopt_long (argc, argv, "dg:hl:v", long_opts, &opti)))
+	{
+		if (opt == EOF) break;
+
+		switch (opt)
+		{
+		case 'd':	debug = 1;			break;
+		case 'g':	gpu = atoi (optarg);		break;
+		case 'l':	library = optarg;		break;
+
+		case 'h':
+			show_help ();
+			exit (0);
+
+		case 'v':
+			show_version ();
+			exit (0);
+
+		default:
+			exit (2);
+		}
+	}
+}
+
+int
+main (int argc, char *argv[])
+{
+	get_options (argc, argv);
+
+	struct nvml_memory memory;
+	unsigned int temp, nvclock, memclock;
+	nvmlDevice_t device;
+	char version[96];
+	void *handle;
+	int i;
+
+	if (!(handle = dlopen (library, RTLD_NOW | RTLD_LOCAL)))
+	{
+		if (debug) fprintf (stderr, "%s: %s\n", prog, dlerror ());
+		return 1;
+	}
+
+	for (i = 0; symbols[i].name; i++)
+		if (!(*symbols[i].func = dlsym (handle, symbols[i].name)))
+		{
+			if (debug) fprintf (stderr, "%s: no %s in %s\n", prog, symbols[i].name, library);
+			return 1;
+		}
+
+	if (nvml.init ())
+	{
+		if (debug) fprintf (stderr, "%s: NVML did not initialise\n", prog);
+		return 1;
+	}
+
+	/* Every value is needed, nvidiainfo falls back to nvidia-settings otherwise */
+	if (nvml.driver_version (version, sizeof (version))
+		|| nvml.device_by_index (gpu, &device)
+		|| nvml.temperature (device, NVML_TEMPERATURE_GPU, &temp)
+		|| nvml.memory (device, &memory)
+		|| nvml.clock (device, NVML_CLOCK_GRAPHICS, &nvclock)
+		|| nvml.clock (device, NVML_CLOCK_MEM, &memclock))
+	{
+		if (debug) fprintf (stderr, "%s: cannot query GPU %u\n", prog, gpu);
+		nvml.shutdown ();
+		return 1;
+	}
+
+	nvml.shutdown ();
+
+	printf ("%s\n%u\n%llu\nnvclock=%u, memclock=%u\n", version, temp, memory.used >> 20, nvclock, memclock);
+
+	return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * nvmlstub.c - Stand-in for the NVML library when testing nvmlquery and nvidiainfo.
+ * Copyright (C) 2013 Digirium, see <https://github.com/Digirium/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Built as a shared library giving the few NVML calls nvmlquery looks up, for
+ * one GPU that is not there, and loaded by nvmlquery with GENMON_NVML set to
+ * it. All return 0 on success, as NVML does, and 2, an invalid argument, for
+ * any other GPU, sensor or clock.
+ */
+#include <stdio.h>
+
+typedef void *nvmlDevice_t;
+
+struct nvml_memory
+{
+	unsigned long long int total, free, used;	/* bytes */
+};
+
+#define NVML_SUCCESS			0
+#define NVML_ERROR_UNINITIALIZED	1
+#define NVML_ERROR_INVALID_ARGUMENT	2
+#define NVML_ERROR_INSUFFICIENT_SIZE	7
+
+static int initialised = 0;
+static int device = 0;
+
+int
+nvmlInit_v2 (void)
+{
+	initialised = 1;
+	return NVML_SUCCESS;
+}
+
+int
+nvmlShutdown (void)
+{
+	if (!initialised) return NVML_ERROR_UNINITIALIZED;
+
+	initialised = 0;
+	return NVML_SUCCESS;
+}
+
+int
+nvmlSystemGetDriverVersion (char *version, unsigned int length)
+{
+	if (!initialised) return NVML_ERROR_UNINITIALIZED;
+
+	if (snprintf (version, length, "550.67") >= (int)length) return NVML_ERROR_INSUFFICIENT_SIZE;
+
+	return NVML_SUCCESS;
+}
+
+int
+nvmlDeviceGetHandleByIndex_v2 (unsigned int index, nvmlDevice_t *handle)
+{
+	if (!initialised) return NVML_ERROR_UNINITIALIZED;
+	if (index != 0) return NVML_ERROR_INVALID_ARGUMENT;
+
+	*handle = &device;
+	return NVML_SUCCESS;
+}
+
+int
+nvmlDeviceGetTemperature (nvmlDevice_t handle, int sensor, unsigned int *temp)
+{
+	if (!initialised) return NVML_ERROR_UNINITIALIZED;
+	if (handle != &device || sensor != 0) return NVML_ERROR_INVALID_ARGUMENT;
+
+	*temp = 52;
+	return NVML_SUCCESS;
+}
+
+int
+nvmlDeviceGetMemoryInfo (nvmlDevice_t handle, struct nvml_memory *memory)
+{
+	if (!initialised) return NVML_ERROR_UNINITIALIZED;
+	if (handle != &device) return NVML_ERROR_INVALID_ARGUMENT;
+
+	memory->total	= 8192ULL << 20;
+	memory->used	= 2048ULL << 20;
+	memory->free	= memory->total - memory->used;
+	return NVML_SUCCESS;
+}
+
+int
+nvmlDeviceGetClockInfo (nvmlDevice_t handle, int type, unsigned int *clock)
+{
+	if (!initialised) return NVML_ERROR_UNINITIALIZED;
+	if (handle != &device) return NVML_ERROR_INVALID_ARGUMENT;
+
+	switch (type)
+	{
+	case 0:	*clock = 1800;	return NVML_SUCCESS;	/* graphics */
+	case 2:	*clock = 7000;	return NVML_SUCCESS;	/* memory */
+	}
+
+	return NVML_ERROR_INVALID_ARGUMENT;
+}
@@ -0,0 +1,805 @@
+/*
+ * pacscan.c - Pacman database scanner for the pacinfo monitor.
+ * Copyright (C) 2013 Digirium, see <https://github.com/Digirium/>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+static char *prog = "pacscan";
+static char *vers = "1.0.0";
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "genmon.h"
+
+/* Option parsing */
+static int debug = 0;
+static char *dbpath = "/var/lib/pacman";
+static char *syncpath = NULL;
+static char *cachedir = "/var/cache/pacman/pkg";
+static char *conffile = "/etc/pacman.conf";
+static char ignorelist[1024];
+static char **filter = NULL;
+static int filters = 0;
+
+/* Sets of package names, open addressed hash tables of offsets into an arena
+ * where each name is followed by its version. The sync databases hold about
+ * 15000 packages for Arch with multilib.
+ */
+#define MAXNAMES	65536
+#define MAXIGNORES	1024
+#define ARENA		(4 << 20)
+
+struct nameset
+{
+	unsigned int *slot;	/* 0 for empty, else offset + 1 */
+	unsigned int size, count;
+};
+
+static unsigned int synctable[MAXNAMES], ignoretable[MAXIGNORES];
+static struct nameset syncset = { synctable, MAXNAMES, 0 };
+static struct nameset ignoreset = { ignoretable, MAXIGNORES, 0 };
+static char arena[ARENA];
+static unsigned int arenalen = 0;
+
+/* Ignored packages given as glob patterns, matched one by one */
+static char *patterns[64];
+static int npatterns = 0;
+
+/* Groups of packages to ignore, from IgnoreGroup, names or globs */
+static char *groups[64];
+static int ngroups = 0;
+
+/* The sync databases in the order pacman.conf lists them, which is the order
+ * pacman takes a package from when more than one has it. A name is at most
+ * what leaves room for .db in a file name. -1 when one could not be taken, and
+ * then the order is not known.
+ */
+#define MAXREPONAME	(NAME_MAX - 3)
+
+static char repos[64][MAXREPONAME + 1];
+static int nrepos = 0;
+
+static unsigned int installed = 0, upgrades = 0;
+static char upgradelist[4096];
+static int upgradelen = 0;
+
+static char dirbuf[65536];
+
+struct linux_dirent64
+{
+	unsigned long long int d_ino;
+	long long int d_off;
+	unsigned short int d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+static void
+show_version (void)
+{
+	printf ("%s %s - (C) 2013 Digirium, see <https://github.com/Digirium>\n", prog, vers);
+	printf ("Released under the GNU GPL.\n\n");
+}
+
+static void
+show_help (void)
+{
+	show_version ();
+
+	printf ("-bDIR --dbpath=DIR	Set the pacman database path (default /var/lib/pacman).\n");
+	printf ("-cDIR --cachedir=DIR	Set the package cache (default /var/cache/pacman/pkg).\n");
+	printf ("-CFILE --config=FILE	Set the pacman configuration (default /etc/pacman.conf).\n");
+	printf ("-d --debug		Display debugging output.\n");
+	printf ("-h --help		Display this help.\n");
+	printf ("-iPKGS --ignore=PKGS	Ignore upgrades of PKGS, names or globs separated by spaces or commas.\n");
+	printf ("-sDIR --syncpath=DIR	Read the sync databases in DIR (default DBPATH/sync).\n");
+	printf ("-v --version		Display version information.\n");
+
+	printf ("\nPrints the number of installed and foreign packages, the size of the\n");
+	printf ("package cache, and the number and names of the packages that can be\n");
+	printf ("upgraded from the sync databases, a name and values to a line. Packages\n");
+	printf ("named after the options are given as the upgrades instead, less those\n");
+	printf ("ignored.\n");
+	printf ("\nLong options may be passed with a single dash.\n\n");
+}
+
+static void
+get_options (int argc, char *argv[])
+{
+	static struct option long_opts[] =
+	{
+		{ "cachedir",	required_argument,	0, 'c' },
+		{ "config",	required_argument,	0, 'C' },
+		{ "dbpath",	required_argument,	0, 'b' },
+		{ "debug",	no_argument,		0, 'd' },
+		{ "help",	no_argument,		0, 'h' },
+		{ "ignore",	required_argument,	0, 'i' },
+		{ "syncpath",	required_argument,	0, 's' },
+		{ "version",	no_argument,		0, 'v' },
+		{ 0,0,0,0 }
+	};
+
+	int opt, opti;
+
+	while ((opt = getopt_long (argc, argv, "b:c:C:dhi:s:v", long_opts, &opti)))
+	{
+		if (opt == EOF) break;
+
+		switch (opt)
+		{
+		case 'b':	dbpath = optarg;		break;
+		case 'c':	cachedir = optarg;		break;
+		case 'C':	conffile = optarg;		break;
+		case 'd':	debug = 1;			break;
+		case 's':	syncpath = optarg;		break;
+
+		case 'i':
+			strncat (ignorelist, " ", sizeof (ignorelist) - strlen (ignorelist) - 1);
+			strncat (ignorelist, optarg, sizeof (ignorelist) - strlen (ignorelist) - 1);
+			break;
+
+		case 'h':
+			show_help ();
+			exit (0);
+
+		case 'v':
+			show_version ();
+			exit (0);
+
+		default:
+			exit (2);
+		}
+	}
+
+	filter = argv + optind;
+	filters = argc - optind;
+}
+
+/* Modification time of a path in nanoseconds, or 0 when it does not exist */
+static unsigned long long int
+mtime (const char *path)
+{
+	struct stat st;
+
+	if (stat (path, &st) < 0) return 0;
+
+	return st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+}
+
+/* Call fn for each entry of a directory but . and .., reading the entries in
+ * large batches with getdents64. Returns the sum of what fn returned, or -1
+ * when the directory cannot be read.
+ */
+static long long int
+scan_dir (const char *path, long long int (*fn) (int dirfd, const char *name, unsigned char type))
+{
+	long long int total = 0;
+	long n, pos;
+	int fd;
+
+	if ((fd = open (path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) return -1;
+
+	while ((n = syscall (SYS_getdents64, fd, dirbuf, sizeof (dirbuf))) > 0)
+		for (pos = 0; pos < n; )
+		{
+			struct linux_dirent64 *entry = (struct linux_dirent64 *)(dirbuf + pos);
+			pos += entry->d_reclen;
+
+			if (entry->d_name[0] == '.' && (!entry->d_name[1] || (entry->d_name[1] == '.' && !entry->d_name[2])))
+				continue;
+
+			total += fn (fd, entry->d_name, entry->d_type);
+		}
+
+	close (fd);
+	return (n < 0) ? -1 : total;
+}
+
+/* Length of the package name in a database entry named NAME-VERSION-RELEASE,
+ * split at the last two dashes as pacman itself does. 0 when it is not one.
+ */
+static int
+name_length (const char *entry, int length)
+{
+	int dashes = 0;
+
+	while (length > 0)
+		if (entry[--length] == '-' && ++dashes == 2) return length;
+
+	return 0;
+}
+
+static unsigned int
+hash (const char *name, int length)
+{
+	unsigned int h = 2166136261U;
+
+	while (length--) h = (h ^ (unsigned char)*name++) * 16777619U;
+
+	return h;
+}
+
+/* Look up a name, returning what is kept for it, the name and then the
+ * version, or NULL when it is not in the set.
+ */
+static const char *
+find (struct nameset *set, const char *name, int length)
+{
+	unsigned int slot = hash (name, length) & (set->size - 1);
+
+	for (; set->slot[slot]; slot = (slot + 1) & (set->size - 1))
+	{
+		const char *known = arena + set->slot[slot] - 1;
+
+		if (!strncmp (known, name, length) && !known[length]) return known;
+	}
+
+	return NULL;
+}
+
+/* Add a name and version to a set unless the name is there already. Returns
+ * 1 when added, 0 when not, and -1 when the set is full.
+ */
+static int
+add (struct nameset *set, const char *name, int length, const char *version, int versionlen)
+{
+	unsigned int slot = hash (name, length) & (set->size - 1);
+
+	for (; set->slot[slot]; slot = (slot + 1) & (set->size - 1))
+	{
+		const char *known = arena + set->slot[slot] - 1;
+
+		if (!strncmp (known, name, length) && !known[length]) return 0;
+	}
+
+	if (set->count >= set->size / 2 || arenalen + length + versionlen + 2 > ARENA) return -1;
+
+	memcpy (arena + arenalen, name, length);
+	arena[arenalen + length] = '\0';
+	memcpy (arena + arenalen + length + 1, version, versionlen);
+	arena[arenalen + length + 1 + versionlen] = '\0';
+
+	set->slot[slot] = arenalen + 1;
+	arenalen += length + versionlen + 2;
+	set->count++;
+
+	return 1;
+}
+
+/* Add packages to ignore, names going in to a set and globs to a list */
+static void
+add_ignores (const char *p)
+{
+	int length;
+
+	for (;;)
+	{
+		while (*p == ' ' || *p == '\t' || *p == ',') p++;
+		if (!*p || *p == '\n') break;
+
+		for (length = 0; p[length] && !strchr (" \t,\n", p[length]); length++);
+
+		if (!strpbrk (p, "*?[") || strpbrk (p, "*?[") >= p + length)
+			add (&ignoreset, p, length, "", 0);
+		else if (npatterns < 64)
+			patterns[npatterns++] = strndup (p, length);
+
+		p += length;
+	}
+}
+
+/* Add groups to ignore, all matched as globs */
+static void
+add_groups (const char *p)
+{
+	int length;
+
+	for (;;)
+	{
+		while (*p == ' ' || *p == '\t') p++;
+		if (!*p || *p == '\n') break;
+
+		for (length = 0; p[length] && !strchr (" \t\n", p[length]); length++);
+
+		if (ngroups < 64) groups[ngroups++] = strndup (p, length);
+
+		p += length;
+	}
+}
+
+/* Whether an installed package, its directory in the local database given,
+ * is in an ignored group, from the %GROUPS% of its desc. pacman goes by the
+ * groups of the new version, which are those of the installed one but for a
+ * package that has since moved between groups.
+ */
+static int
+in_ignored_group (int dirfd, const char *name)
+{
+	char path[320], buffer[8192], *p, *eol;
+	int fd, len, i;
+
+	if (!ngroups) return 0;
+
+	snprintf (path, sizeof (path), "%s/desc", name);
+	if ((fd = openat (dirfd, path, O_RDONLY | O_CLOEXEC)) < 0) return 0;
+
+	len = read (fd, buffer, sizeof (buffer) - 1);
+	close (fd);
+
+	if (len <= 0) return 0;
+	buffer[len] = '\0';
+
+	if (!(p = strstr (buffer, "%GROUPS%\n"))) return 0;
+
+	/* A group a line up to an empty one, one cut short is not matched */
+	for (p += 9; *p != '\n' && (eol = strchr (p, '\n')); p = eol + 1)
+	{
+		*eol = '\0';
+
+		for (i = 0; i < ngroups; i++)
+			if (!fnmatch (groups[i], p, 0)) return 1;
+	}
+
+	return 0;
+}
+
+static int
+is_ignored (const char *name, int length)
+{
+	char buffer[256];
+	int i;
+
+	if (find (&ignoreset, name, length)) return 1;
+
+	snprintf (buffer, 256, "%.*s", length, name);
+
+	for (i = 0; i < npatterns; i++)
+		if (!fnmatch (patterns[i], buffer, 0)) return 1;
+
+	return 0;
+}
+
+/* Take the repositories, IgnorePkg and IgnoreGroup from pacman.conf. Include
+ * files are not followed, they only list the servers of a repository.
+ */
+static void
+read_conf (void)
+{
+	const char *p, *eol;
+	int length;
+
+	for (p = genmon_read_proc (conffile); p && *p; p = eol ? eol + 1 : NULL)
+	{
+		eol = strchr (p, '\n');
+
+		while (*p == ' ' || *p == '\t') p++;
+
+		if (*p == '[')
+		{
+			for (length = 1; p[length] && p[length] != ']' && p[length] != '\n'; length++);
+
+			if (p[length] != ']' || !strncmp (p, "[options]", 9) || nrepos < 0) continue;
+
+			if (nrepos < 64 && length - 1 <= MAXREPONAME)
+				snprintf (repos[nrepos++], MAXREPONAME + 1, "%.*s", length - 1, p + 1);
+			else
+			{
+				if (debug) fprintf (stderr, "%s: cannot take repository %.*s\n", prog, length - 1, p + 1);
+				nrepos = -1;
+			}
+		}
+		else if (!strncmp (p, "IgnorePkg", 9))
+		{
+			for (p += 9; *p == ' ' || *p == '\t'; p++);
+			if (*p == '=') add_ignores (p + 1);
+		}
+		else if (!strncmp (p, "IgnoreGroup", 11))
+		{
+			for (p += 11; *p == ' ' || *p == '\t'; p++);
+			if (*p == '=') add_groups (p + 1);
+		}
+	}
+}
+
+/* The packages to ignore, from pacman.conf and the options, read once */
+static void
+read_ignores (void)
+{
+	static int done = 0;
+
+	if (done++) return;
+
+	read_conf ();
+	add_ignores (ignorelist);
+}
+
+/* Compare two alphanumeric version strings as pacman does, part by part,
+ * numbers by value and letters by letter, with a number newer than letters.
+ */
+static int
+rpmvercmp (const char *a, int alen, const char *b, int blen)
+{
+	const char *one = a, *two = b, *enda = a + alen, *endb = b + blen;
+	const char *ptr1, *ptr2;
+	int isnum, len1, len2, rc;
+
+	if (alen == blen && !memcmp (a, b, alen)) return 0;
+
+	ptr1 = one, ptr2 = two;
+
+	while (one < enda && two < endb)
+	{
+		while (one < enda && !isalnum ((unsigned char)*one)) one++;
+		while (two < endb && !isalnum ((unsigned char)*two)) two++;
+
+		if (one == enda || two == endb) break;
+
+		/* Separators of different lengths decide it */
+		if (one - ptr1 != two - ptr2) return (one - ptr1 < two - ptr2) ? -1 : 1;
+
+		ptr1 = one, ptr2 = two;
+
+		if (isdigit ((unsigned char)*ptr1))
+		{
+			while (ptr1 < enda && isdigit ((unsigned char)*ptr1)) ptr1++;
+			while (ptr2 < endb && isdigit ((unsigned char)*ptr2)) ptr2++;
+			isnum = 1;
+		}
+		else
+		{
+			while (ptr1 < enda && isalpha ((unsigned char)*ptr1)) ptr1++;
+			while (ptr2 < endb && isalpha ((unsigned char)*ptr2)) ptr2++;
+			isnum = 0;
+		}
+
+		/* Parts of different kinds, a number is newer */
+		if (two == ptr2) return isnum ? 1 : -1;
+
+		if (isnum)
+		{
+			while (one < ptr1 - 1 && *one == '0') one++;
+			while (two < ptr2 - 1 && *two == '0') two++;
+
+			if (ptr1 - one != ptr2 - two) return (ptr1 - one > ptr2 - two) ? 1 : -1;
+		}
+
+		len1 = ptr1 - one, len2 = ptr2 - two;
+
+		if ((rc = memcmp (one, two, (len1 < len2) ? len1 : len2)) || (rc = len1 - len2))
+			return (rc < 0) ? -1 : 1;
+
+		one = ptr1, two = ptr2;
+	}
+
+	if (one == enda && two == endb) return 0;
+
+	/* Whatever is left is newer, except letters, so that 1.0a is older than 1.0 */
+	if ((one == enda && !isalpha ((unsigned char)*two)) || (one < enda && isalpha ((unsigned char)*one))) return -1;
+
+	return 1;
+}
+
+/* Compare versions of the form [EPOCH:]VERSION[-RELEASE] as pacman does.
+ * Returns less than, equal to or more than 0 as a is older, the same or newer.
+ */
+static int
+vercmp (const char *a, const char *b)
+{
+	const char *va = a, *vb = b, *ea = "0", *eb = "0", *ra, *rb;
+	int elena = 1, elenb = 1, rc;
+
+	if (!strcmp (a, b)) return 0;
+
+	while (isdigit ((unsigned char)*va)) va++;
+	if (*va == ':') { ea = a, elena = va - a, va++; } else va = a;
+	if (!elena) ea = "0", elena = 1;
+
+	while (isdigit ((unsigned char)*vb)) vb++;
+	if (*vb == ':') { eb = b, elenb = vb - b, vb++; } else vb = b;
+	if (!elenb) eb = "0", elenb = 1;
+
+	ra = strrchr (va, '-');
+	rb = strrchr (vb, '-');
+
+	if ((rc = rpmvercmp (ea, elena, eb, elenb))) return rc;
+
+	if ((rc = rpmvercmp (va, ra ? ra - va : (int)strlen (va), vb, rb ? rb - vb : (int)strlen (vb)))) return rc;
+
+	/* The release only counts when both have one */
+	if (ra && rb) return rpmvercmp (ra + 1, strlen (ra + 1), rb + 1, strlen (rb + 1));
+
+	return 0;
+}
+
+/* Add a package to those that can be upgraded */
+static void
+add_upgrade (const char *name, int length)
+{
+	upgrades++;
+
+	if (upgradelen + length + 2 < (int)sizeof (upgradelist))
+		upgradelen += sprintf (upgradelist + upgradelen, "%s%.*s", upgradelen ? " " : "", length, name);
+}
+
+/* Add the names of the packages in a sync database. The databases are tar
+ * archives, normally compressed with gzip, of a directory for each package.
+ * Returns 1 when the archive cannot be read, as when it is in another format.
+ */
+static long long int
+read_syncdb (int dirfd, const char *name, unsigned char type)
+{
+	int length = strlen (name);
+
+	/* A directory, say one a mirror tool left, is never a database */
+	if (type == DT_DIR || length < 4 || strcmp (name + length - 3, ".db")) return 0;
+
+	int fd = openat (dirfd, name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		if (debug) fprintf (stderr, "%s: cannot open %s\n", prog, name);
+		return 1;
+	}
+
+	gzFile file = gzdopen (fd, "rb");
+	if (!file)
+	{
+		close (fd);
+		return 1;
+	}
+
+	unsigned char header[512];
+	char path[512];
+	int ok = 0, longname = 0;
+
+	while (gzread (file, header, 512) == 512)
+	{
+		if (!header[0])
+		{
+			ok = 1;		/* the end of the archive */
+			break;
+		}
+
+		unsigned long long int size = 0;
+		int i;
+
+		for (i = 124; i < 136 && header[i] >= '0' && header[i] <= '7'; i++) size = size * 8 + (header[i] - '0');
+
+		/* GNU tar gives a long name in the data of an entry of its own */
+		if (header[156] == 'L')
+		{
+			if (size >= sizeof (path) || gzread (file, path, (size + 511) & ~511ULL) != (int)((size + 511) & ~511ULL))
+				break;
+
+			path[size] = '\0';
+			longname = 1;
+			continue;
+		}
+
+		if (!longname)
+		{
+			/* A ustar header may have the start of the path in its prefix */
+			if (!memcmp (header + 257, "ustar", 5) && header[345])
+				snprintf (path, sizeof (path), "%.155s/%.100s", header + 345, header);
+			else
+				snprintf (path, sizeof (path), "%.100s", header);
+		}
+		longname = 0;
+
+		char *slash = strchr (path, '/');
+		int entry = slash ? slash - path : (int)strlen (path);
+		int namelen = name_length (path, entry);
+
+		if (namelen && add (&syncset, path, namelen, path + namelen + 1, entry - namelen - 1) < 0) break;
+
+		if (size && gzseek (file, (size + 511) & ~511ULL, SEEK_CUR) < 0) break;
+	}
+
+	gzclose (file);
+
+	if (!ok && debug) fprintf (stderr, "%s: cannot read %s\n", prog, name);
+
+	return ok ? 0 : 1;
+}
+
+/* Count the installed packages, the directories of the local database */
+static long long int
+count_local (int dirfd, const char *name, unsigned char type)
+{
+	struct stat st;
+
+	if (type == DT_UNKNOWN)
+		type = (fstatat (dirfd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR (st.st_mode)) ? DT_DIR : DT_REG;
+
+	return (type == DT_DIR && name_length (name, strlen (name))) ? 1 : 0;
+}
+
+/* Count those that are in no sync database, as pacman -Qm lists them, and
+ * all of them along the way. Those that a sync database has a newer version
+ * of, and that are not ignored by name or by group, can be upgraded.
+ */
+static long long int
+count_foreign (int dirfd, const char *name, unsigned char type)
+{
+	const char *known;
+	int namelen;
+
+	if (!count_local (dirfd, name, type)) return 0;
+	installed++;
+
+	namelen = name_length (name, strlen (name));
+
+	if (!(known = find (&syncset, name, namelen))) return 1;
+
+	if (vercmp (known + namelen + 1, name + namelen + 1) > 0 && !is_ignored (name, namelen)
+		&& !in_ignored_group (dirfd, name))
+		add_upgrade (name, namelen);
+
+	return 0;
+}
+
+/* Bytes used by a file in the package cache */
+static long long int
+cache_bytes (int dirfd, const char *name, unsigned char type)
+{
+	struct stat st;
+
+	/* What is known not to be a file is passed over without a stat */
+	if (type != DT_REG && type != DT_UNKNOWN) return 0;
+
+	if (fstatat (dirfd, name, &st, AT_SYMLINK_NOFOLLOW) < 0 || !S_ISREG (st.st_mode)) return 0;
+
+	return st.st_blocks * 512LL;
+}
+
+/* A size as du -h gives it */
+static char *
+human (char *buffer, unsigned long long int bytes)
+{
+	static const char units[] = "KMGTPE";
+	double size = bytes / 1024.0;
+	int unit = 0;
+
+	if (!bytes) return strcpy (buffer, "0");
+
+	while (size >= 1024.0 && unit < 5) size /= 1024.0, unit++;
+
+	if (size < 10.0)	sprintf (buffer, "%.1f%c", size, units[unit]);
+	else			sprintf (buffer, "%.0f%c", size, units[unit]);
+
+	return buffer;
+}
+
+int
+main (int argc, char *argv[])
+{
+	get_options (argc, argv);
+
+	struct genmon_pac_state cache, now;
+	struct genmon_state *state;
+	char local[320], sync[320], buffer[32], dbname[NAME_MAX + 1];
+	long long int n;
+	int i;
+
+	snprintf (local, 320, "%s/local", dbpath);
+	snprintf (sync, 320, "%s", syncpath ? syncpath : "");
+	if (!syncpath) snprintf (sync, 320, "%s/sync", dbpath);
+
+	/* Installing, removing or upgrading a package changes the entries of the
+	 * local database, refreshing the sync databases renames new ones in to
+	 * place, and the cache gains or loses files. Any of these changes the
+	 * modification time of the directory, so when none has changed the counts
+	 * from the last run still hold.
+	 */
+	memset (&now, 0, sizeof (now));
+	now.localmtime	= mtime (local);
+	now.syncmtime	= mtime (sync);
+	now.cachemtime	= mtime (cachedir);
+	now.conf	= mtime (conffile) ^ ((unsigned long long int)hash (sync, strlen (sync)) << 32) ^ hash (ignorelist, strlen (ignorelist));
+
+	if (!now.localmtime) return 1;
+
+	state = genmon_state_open ("pacscan", sizeof (cache), 1);
+
+	if (!state || !genmon_state_read (state, GENMON_PACMAN, &cache, sizeof (cache))) memset (&cache, 0, sizeof (cache));
+
+	if (now.localmtime == cache.localmtime && now.syncmtime == cache.syncmtime && now.conf == cache.conf)
+	{
+		now.installed	= cache.installed;
+		now.foreign	= cache.foreign;
+		now.upgrades	= cache.upgrades;
+		memcpy (now.upgradelist, cache.upgradelist, sizeof (now.upgradelist));
+	}
+	else
+	{
+		if (debug) fprintf (stderr, "%s: scanning %s\n", prog, dbpath);
+
+		/* A sync database that cannot be read would make its packages look
+		 * foreign, so give up and let pacman be asked instead.
+		 */
+		read_ignores ();
+
+		if (nrepos < 0) n = 1;
+		else if (nrepos)
+		{
+			int fd = open (sync, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+			for (i = 0, n = (fd < 0); i < nrepos && !n; i++)
+			{
+				snprintf (dbname, sizeof (dbname), "%.*s.db", MAXREPONAME, repos[i]);
+				n = read_syncdb (fd, dbname, 0);
+			}
+
+			if (fd >= 0) close (fd);
+		}
+		else n = scan_dir (sync, read_syncdb);
+
+		if (n)
+		{
+			if (debug) fprintf (stderr, "%s: cannot read the sync databases\n", prog);
+			return 1;
+		}
+
+		if ((n = scan_dir (local, count_foreign)) < 0) return 1;
+		now.foreign = n;
+		now.installed = installed;
+		now.upgrades = upgrades;
+		snprintf (now.upgradelist, sizeof (now.upgradelist), "%s", upgradelist);
+	}
+
+	if (now.cachemtime == cache.cachemtime)
+		now.cachebytes = cache.cachebytes;
+	else if ((n = scan_dir (cachedir, cache_bytes)) > 0)
+		now.cachebytes = n;
+
+	if (state)
+	{
+		if (memcmp (&now, &cache, sizeof (now))) genmon_state_write (state, GENMON_PACMAN, &now, sizeof (now));
+		genmon_state_close (state, sizeof (now));
+	}
+
+	printf ("installed %u\nforeign %u\ncache %s\n", now.installed, now.foreign, human (buffer, now.cachebytes));
+
+	/* Upgrades found some other way, as by an AUR helper, only need the
+	 * ignored packages taken out.
+	 */
+	if (filters)
+	{
+		read_ignores ();
+
+		upgrades = upgradelen = 0;
+		upgradelist[0] = '\0';
+
+		for (i = 0; i < filters; i++)
+			if (!is_ignored (filter[i], strlen (filter[i]))) add_upgrade (filter[i], strlen (filter[i]));
+
+		now.upgrades = upgrades;
+		snprintf (now.upgradelist, sizeof (now.upgradelist), "%s", upgradelist);
+	}
+
+	printf ("upgrades %u\nupgradelist %s\n", now.upgrades, now.upgradelist);
+
+	return 0;
+}